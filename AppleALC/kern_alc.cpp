@@ -9,10 +9,12 @@
 #include <Headers/kern_devinfo.hpp>
 #include <Headers/plugin_start.hpp>
 #include <Headers/kern_compression.hpp>
+#include <Headers/kern_file.hpp>
 #include <IOKit/IOService.h>
 #include <IOKit/pci/IOPCIDevice.h>
 #include <mach/vm_map.h>
 #include <libkern/c++/OSUnserialize.h>
+#include <libkern/zlib.h>
 
 #include "kern_alc.hpp"
 #include "kern_resources.hpp"
@@ -33,6 +35,14 @@ void AlcEnabler::createShared() {
 }
 
 void AlcEnabler::init() {
+	// Select the patches valid for this kernel once, newer kernels share the last bucket
+	uint32_t kernel = getKernelVersion();
+	if (kernel >= ADDPR(patchBucketMin)) {
+		size_t bucket = kernel - ADDPR(patchBucketMin);
+		if (bucket >= ADDPR(patchBucketNum))
+			bucket = ADDPR(patchBucketNum) - 1;
+		patchBucket = &ADDPR(patchBucketStart)[bucket * ADDPR(patchListNum)];
+	}
 
 	lilu.onPatcherLoadForce(
 	[](void *user, KernelPatcher &patcher) {
@@ -72,6 +82,8 @@ void AlcEnabler::deinit() {
 	controllers.deinit();
 #ifdef HAVE_ANALOG_AUDIO
 	codecs.deinit();
+	Buffer::deleter(externalPack);
+	externalPack = nullptr;
 #endif
 }
 
@@ -480,17 +492,21 @@ void AlcEnabler::processKext(KernelPatcher &patcher, size_t index, mach_vm_addre
 				continue;
 			}
 
-			DBGLOG("alc", "handling %lu controller %X:%X with %lu patches - %s", i, info->vendor, info->device, info->patchNum, info->name);
+			DBGLOG("alc", "handling %lu controller %X:%X with %u patches - %s", i, info->vendor, info->device, info->patchNum, info->name.get());
 			// Choose a free device-id for NVIDIA HDAU to support multigpu setups
 			if (info->vendor == WIOKit::VendorID::NVIDIA) {
 				for (size_t j = 0; j < info->patchNum; j++) {
-					auto &p = info->patches[j].patch;
-					if (p.size == sizeof(uint32_t) && *reinterpret_cast<const uint32_t *>(p.find) == NvidiaSpecialFind) {
-						DBGLOG("alc", "finding %08X repl at %lu curr %lu", *reinterpret_cast<const uint32_t *>(p.replace), i, currentFreeNvidiaDeviceId);
+					auto &p = info->patches[j];
+					auto patchIndex = static_cast<uint32_t>(&p - ADDPR(kextPatches));
+					if (p.size == sizeof(uint32_t) && !nvidiaFindOverride(patchIndex) && *reinterpret_cast<const uint32_t *>(p.find.get()) == NvidiaSpecialFind) {
+						DBGLOG("alc", "finding %08X repl at %lu curr %lu", *reinterpret_cast<const uint32_t *>(p.replace.get()), i, currentFreeNvidiaDeviceId);
 						while (currentFreeNvidiaDeviceId < MaxNvidiaDeviceIds) {
 							if (!nvidiaDeviceIdUsage[currentFreeNvidiaDeviceId]) {
-								p.find = reinterpret_cast<const uint8_t *>(&nvidiaDeviceIdList[currentFreeNvidiaDeviceId]);
-								DBGLOG("alc", "assigned %08X find %08X repl at %lu curr %lu", *reinterpret_cast<const uint32_t *>(p.find), *reinterpret_cast<const uint32_t *>(p.replace), i, currentFreeNvidiaDeviceId);
+								// Generated patches are read-only, the chosen find is applied in applyPatches
+								nvidiaPatchIndex[nvidiaPatchNum] = patchIndex;
+								nvidiaPatchDeviceId[nvidiaPatchNum] = currentFreeNvidiaDeviceId;
+								nvidiaPatchNum++;
+								DBGLOG("alc", "assigned %08X find %08X repl at %lu curr %lu", nvidiaDeviceIdList[currentFreeNvidiaDeviceId], *reinterpret_cast<const uint32_t *>(p.replace.get()), i, currentFreeNvidiaDeviceId);
 								nvidiaDeviceIdUsage[currentFreeNvidiaDeviceId] = true;
 								currentFreeNvidiaDeviceId++;
 								break;
@@ -505,7 +521,7 @@ void AlcEnabler::processKext(KernelPatcher &patcher, size_t index, mach_vm_addre
 				DBGLOG("alc", "skipping %lu controller %X:%X:%X due to no-controller-patch", i, controllers[i]->vendor, controllers[i]->device, controllers[i]->revision);
 				continue;
 			}
-			applyPatches(patcher, index, info->patches, info->patchNum);
+			applyPatches(patcher, index, info->patches.get(), info->patchNum, info->patchList);
 		}
 
 		// Only do this if -alcdbg is not passed
@@ -522,12 +538,12 @@ void AlcEnabler::processKext(KernelPatcher &patcher, size_t index, mach_vm_addre
 				continue;
 			}
 			
-			if (info->platformNum > 0 || info->layoutNum > 0) {
+			if (codecs[i]->hasResources) {
 				DBGLOG("alc", "will route resource loading callbacks");
 				progressState |= ProcessingState::CallbacksWantRouting;
 			}
 			
-			applyPatches(patcher, index, info->patches, info->patchNum);
+			applyPatches(patcher, index, info->patches.get(), info->patchNum, info->patchList);
 		}
 	}
 	
@@ -615,6 +631,15 @@ void AlcEnabler::grabControllers() {
 			WIOKit::getOSDataValue(sect, "alc-layout-id", lid)) {
 
 			insertController(ven, dev, rev, ControllerModInfo::PlatformAny, nullptr != sect->getProperty("no-controller-patch"), lid, sect);
+
+#ifdef HAVE_ANALOG_AUDIO
+			// alcpack=X has priority over alc-pack-path property set by the bootloader
+			if (!lilu_get_boot_args("alcpack", externalPackPath, sizeof(externalPackPath))) {
+				auto path = OSDynamicCast(OSData, sect->getProperty("alc-pack-path"));
+				if (path && path->getLength() > 0 && path->getLength() < sizeof(externalPackPath))
+					lilu_os_memcpy(externalPackPath, path->getBytesNoCopy(), path->getLength());
+			}
+#endif
 		} else {
 			SYSLOG("alc", "failed to obtain device info for analog controller (%d)", devInfo->audioBuiltinAnalog != nullptr);
 		}
@@ -633,36 +658,35 @@ void AlcEnabler::grabControllers() {
 void AlcEnabler::validateControllers() {
 	for (size_t i = 0, num = controllers.size(); i < num; i++) {
 		DBGLOG("alc", "validating %lu controller %X:%X:%X", i, controllers[i]->vendor, controllers[i]->device, controllers[i]->revision);
-		for (size_t mod = 0; mod < ADDPR(controllerModSize); mod++) {
-			DBGLOG("alc", "comparing to %lu mod %X:%X", mod, ADDPR(controllerMod)[mod].vendor, ADDPR(controllerMod)[mod].device);
-			if (controllers[i]->vendor == ADDPR(controllerMod)[mod].vendor &&
-				controllers[i]->device == ADDPR(controllerMod)[mod].device) {
-
-				// Check revision if present
-				size_t rev {0};
-				while (rev < ADDPR(controllerMod)[mod].revisionNum &&
-					   ADDPR(controllerMod)[mod].revisions[rev] != controllers[i]->revision)
-					rev++;
-
-				// Check AAPL,ig-platform-id if present
-				if (ADDPR(controllerMod)[mod].platform != ControllerModInfo::PlatformAny &&
-					ADDPR(controllerMod)[mod].platform != controllers[i]->platform) {
-					DBGLOG("alc", "not matching platform was found %X vs %X for %s", ADDPR(controllerMod)[mod].platform, controllers[i]->platform, &ADDPR(controllerMod)[mod].name);
-					continue;
-				}
+		auto lookup = lookupController(controllers[i]->vendor, controllers[i]->device);
+		if (!lookup) {
+			DBGLOG("alc", "no mods for %lu controller", i);
+			continue;
+		}
 
-				// Check if computer model is suitable
-				if (!(computerModel & ADDPR(controllerMod)[mod].computerModel)) {
-					DBGLOG("alc", "unsuitable computer model was found %X vs %X for %s", ADDPR(controllerMod)[mod].computerModel, computerModel, &ADDPR(controllerMod)[mod].name);
-					continue;
-				}
+		for (size_t c = 0; c < lookup->candidateNum; c++) {
+			auto &candidate = ADDPR(controllerCandidates)[lookup->candidateStart + c];
+			auto &mod = ADDPR(controllerMod)[candidate.mod];
+			DBGLOG("alc", "comparing to %u mod %X:%X", candidate.mod, mod.vendor, mod.device);
 
-				if (rev != ADDPR(controllerMod)[mod].revisionNum ||
-					ADDPR(controllerMod)[mod].revisionNum == 0) {
-					DBGLOG("alc", "found mod for %lu controller - %s", i, &ADDPR(controllerMod)[mod].name);
-					controllers[i]->info= &ADDPR(controllerMod)[mod];
-					break;
-				}
+			// Check AAPL,ig-platform-id if present
+			if ((candidate.checks & ControllerCandidate::CheckPlatform) && mod.platform != controllers[i]->platform) {
+				DBGLOG("alc", "not matching platform was found %X vs %X for %s", mod.platform, controllers[i]->platform, mod.name.get());
+				continue;
+			}
+
+			// Check if computer model is suitable
+			if (!(computerModel & mod.computerModel)) {
+				DBGLOG("alc", "unsuitable computer model was found %X vs %X for %s", mod.computerModel, computerModel, mod.name.get());
+				continue;
+			}
+
+			// Check revision if present
+			if (!(candidate.checks & ControllerCandidate::CheckRevision) ||
+				matchRevision(mod.revisions.get(), mod.revisionNum, controllers[i]->revision)) {
+				DBGLOG("alc", "found mod for %lu controller - %s", i, mod.name.get());
+				controllers[i]->info = &mod;
+				break;
 			}
 		}
 	}
@@ -738,7 +762,24 @@ void AlcEnabler::patchPinConfig(IOService *hdaCodec, IORegistryEntry *configDevi
 				unsigned int total = configList->getCount();
 				DBGLOG("alc", "discovered HDAConfigDefault with %u entries", total);
 
-				for (unsigned int i = 0; i < total; i++) {
+				// The generated index points straight at the entry, the whole list is only scanned
+				// when PinConfigs does not match the index it was built from.
+				unsigned int start = 0, end = total;
+				auto lookup = lookupPinConfig(analogCodec, analogLayout);
+				if (lookup && lookup->index < total) {
+					auto config = OSDynamicCast(OSDictionary, configList->getObject(lookup->index));
+					auto currCodec = config ? OSDynamicCast(OSNumber, config->getObject("CodecID")) : nullptr;
+					auto currLayout = config ? OSDynamicCast(OSNumber, config->getObject("LayoutID")) : nullptr;
+					if (currCodec && currLayout && currCodec->unsigned32BitValue() == analogCodec && currLayout->unsigned32BitValue() == analogLayout) {
+						start = lookup->index;
+						end = start + 1;
+					} else {
+						SYSLOG("alc", "HDAConfigDefault index is stale, scanning %u entries", total);
+						lookup = nullptr;
+					}
+				}
+
+				for (unsigned int i = start; i < end; i++) {
 					auto config = OSDynamicCast(OSDictionary, configList->getObject(i));
 					if (config == nullptr) {
 						SYSLOG("alc", "invalid HDAConfigDefault entry at %u, pinconfigs are broken", i);
@@ -761,8 +802,29 @@ void AlcEnabler::patchPinConfig(IOService *hdaCodec, IORegistryEntry *configDevi
 						break;
 					}
 
-					auto configData = OSDynamicCast(OSData, config->getObject("ConfigData"));
-					auto wakeConfigData = OSDynamicCast(OSData, config->getObject("WakeConfigData"));
+					// Verb programs compiled at build time replace the original streams unless they were edited since
+					if (lookup) {
+						auto setProgram = [newConfig](const char *key, uint32_t start, uint32_t size, uint32_t sourceSize, uint32_t sourceChecksum) {
+							if (size == 0)
+								return;
+							auto source = OSDynamicCast(OSData, newConfig->getObject(key));
+							if (!source || source->getLength() != sourceSize ||
+								ResourcePack::checksum(static_cast<const uint8_t *>(source->getBytesNoCopy()), sourceSize) != sourceChecksum) {
+								SYSLOG("alc", "%s differs from the one compiled at build time, keeping it", key);
+								return;
+							}
+							auto program = OSData::withBytesNoCopy(const_cast<uint8_t *>(&ADDPR(pinConfigVerbs)[start]), size);
+							if (program) {
+								newConfig->setObject(key, program);
+								program->release();
+							}
+						};
+						setProgram("ConfigData", lookup->configStart, lookup->configSize, lookup->configSourceSize, lookup->configSourceChecksum);
+						setProgram("WakeConfigData", lookup->wakeStart, lookup->wakeSize, lookup->wakeSourceSize, lookup->wakeSourceChecksum);
+					}
+
+					auto configData = OSDynamicCast(OSData, newConfig->getObject("ConfigData"));
+					auto wakeConfigData = OSDynamicCast(OSData, newConfig->getObject("WakeConfigData"));
 					auto reinitBool = OSDynamicCast(OSBoolean, config->getObject("WakeVerbReinit"));
 					auto reinit = reinitBool != nullptr ? reinitBool->getValue() : false;
 					DBGLOG("alc", "current config entry has boot %d, wake %d, reinit %d", configData != nullptr,
@@ -800,6 +862,8 @@ void AlcEnabler::patchPinConfig(IOService *hdaCodec, IORegistryEntry *configDevi
 						break;
 					}
 
+					configData = OSDynamicCast(OSData, newConfig->getObject("ConfigData"));
+					wakeConfigData = OSDynamicCast(OSData, newConfig->getObject("WakeConfigData"));
 					if (wakeConfigData != nullptr) {
 						if (configData != nullptr) {
 							newConfig->setObject("BootConfigData", configData);
@@ -875,34 +939,34 @@ void AlcEnabler::updateResource(Resource type, kern_return_t &result, const void
 			continue;
 		}
 
-		if ((type == Resource::Platform && info->platforms) || (type == Resource::Layout && info->layouts)) {
-			size_t num = type == Resource::Platform ? info->platformNum : info->layoutNum;
-			DBGLOG("alc", "selecting from %lu files", num);
-			for (size_t f = 0; f < num; f++) {
-				auto &fi = (type == Resource::Platform ? info->platforms : info->layouts)[f];
-				DBGLOG("alc", "comparing %lu layout %X/%X", f, fi.layout, controllers[codecs[i]->controller]->layout);
-				if (controllers[codecs[i]->controller]->layout == fi.layout && KernelPatcher::compatibleKernel(fi.minKernel, fi.maxKernel)) {
-					DBGLOG("alc", "found %s at %lu index, zlib %u", type == Resource::Platform ? "platform" : "layout", f, isAppleHDAZlib);
-					
-					// decompress resource for non-zlib systems
-					if (!isAppleHDAZlib) {
-						uint32_t bufferLength = 0x7A000; // Buffer size that AppleHDA uses.
-						auto buffer = Compression::decompress(Compression::ModeZLIB, &bufferLength, fi.data, fi.dataLength, nullptr);
-						if (!buffer) {
-							break;
-						}
-						
-						resourceData = buffer;
-						resourceDataLength = bufferLength;
+		auto &fi = type == Resource::Platform ? codecs[i]->platform : codecs[i]->layout;
+		fetchExternalResource(fi);
+		if (fi) {
+			DBGLOG("alc", "found %s for layout %X, zlib %u", type == Resource::Platform ? "platform" : "layout", fi.layout, isAppleHDAZlib);
 
-					} else {
-						resourceData = fi.data;
-						resourceDataLength = fi.dataLength;
-					}
-					result = kOSReturnSuccess;
-					break;
+			// decompress resource for non-zlib systems
+			if (!isAppleHDAZlib) {
+				uint32_t bufferLength = 0;
+				auto buffer = decompressCodecResource(fi, bufferLength);
+				if (!buffer) {
+					continue;
 				}
+
+				resourceData = buffer;
+				resourceDataLength = bufferLength;
+
+			} else if (fi.dictionary || fi.rawData) {
+				// AppleHDA knows nothing about the preset dictionary or deltas
+				if (!preparePlainZlib(fi))
+					continue;
+
+				resourceData = fi.plainData;
+				resourceDataLength = fi.plainLength;
+			} else {
+				resourceData = fi.data;
+				resourceDataLength = fi.dataLength;
 			}
+			result = kOSReturnSuccess;
 		}
 	}
 }
@@ -973,44 +1037,39 @@ bool AlcEnabler::grabCodecs() {
 
 bool AlcEnabler::validateCodecs() {
 	size_t i = 0;
+
+	// External pack is read once, built-in resources are used when it is missing or damaged
+	if (externalPackPath[0] != '\0' && !externalPack && !loadExternalPack())
+		externalPackPath[0] = '\0';
 	
 	while (i < codecs.size()) {
 		bool suitable {false};
 		
-		// Check vendor
-		size_t vIdx {0};
-		while (vIdx < ADDPR(vendorModSize) && ADDPR(vendorMod)[vIdx].vendor != codecs[i]->vendor)
-			vIdx++;
-		
-		if (vIdx != ADDPR(vendorModSize)) {
-			// Check codec
-			size_t cIdx {0};
-			while (cIdx < ADDPR(vendorMod)[vIdx].codecsNum &&
-				   ADDPR(vendorMod)[vIdx].codecs[cIdx].codec != codecs[i]->codec)
-				cIdx++;
-			
-			if (cIdx != ADDPR(vendorMod)[vIdx].codecsNum) {
-				// Check revision if present
-				size_t rIdx {0};
-				while (rIdx < ADDPR(vendorMod)[vIdx].codecs[cIdx].revisionNum &&
-					   ADDPR(vendorMod)[vIdx].codecs[cIdx].revisions[rIdx] != codecs[i]->revision)
-					rIdx++;
-				
-				if (rIdx != ADDPR(vendorMod)[vIdx].codecs[cIdx].revisionNum ||
-					ADDPR(vendorMod)[vIdx].codecs[cIdx].revisionNum == 0) {
-					codecs[i]->info = &ADDPR(vendorMod)[vIdx].codecs[cIdx];
-					suitable = true;
-				}
-				
-				DBGLOG("alc", "found %s %s %s codec revision 0x%X",
-					   suitable ? "supported" : "unsupported", ADDPR(vendorMod)[vIdx].name,
-					   ADDPR(vendorMod)[vIdx].codecs[cIdx].name, codecs[i]->revision);
-			} else {
-				DBGLOG("alc", "found unsupported %s codec 0x%X revision 0x%X", ADDPR(vendorMod)[vIdx].name,
-					   codecs[i]->codec, codecs[i]->revision);
+		auto lookup = lookupCodec(codecs[i]->vendor, codecs[i]->codec);
+		if (lookup) {
+			// Check revision if present
+			if (matchRevision(lookup->codec->revisions.get(), lookup->codec->revisionNum, codecs[i]->revision)) {
+				codecs[i]->info = lookup->codec.get();
+				suitable = true;
+
+				// Resolve resource files for the running kernel once
+				auto layout = controllers[codecs[i]->controller]->layout;
+				codecs[i]->platform = selectCodecResource(lookup->codec.get(), codecs[i]->vendor, ResourcePack::KindPlatform, layout);
+				codecs[i]->layout = selectCodecResource(lookup->codec.get(), codecs[i]->vendor, ResourcePack::KindLayout, layout);
+				codecs[i]->platform.external = findExternalResource(codecs[i]->vendor, codecs[i]->codec, ResourcePack::KindPlatform, layout);
+				codecs[i]->layout.external = findExternalResource(codecs[i]->vendor, codecs[i]->codec, ResourcePack::KindLayout, layout);
+				// Routing does not depend on the selection, pin config and power state hooks need it for every layout-id
+				codecs[i]->hasResources = hasCodecResources(lookup->codec.get(), codecs[i]->vendor) || codecs[i]->platform || codecs[i]->layout;
+				DBGLOG("alc", "selected platform %u layout %u bytes for layout-id %u", codecs[i]->platform.dataLength,
+					   codecs[i]->layout.dataLength, layout);
 			}
+			
+			DBGLOG("alc", "found %s %s %s codec revision 0x%X",
+				   suitable ? "supported" : "unsupported", lookup->vendor->name.get(),
+				   lookup->codec->name.get(), codecs[i]->revision);
 		} else {
-			DBGLOG("alc", "found unsupported codec vendor 0x%X", codecs[i]->vendor);
+			DBGLOG("alc", "found unsupported codec 0x%X:0x%X revision 0x%X", codecs[i]->vendor,
+				   codecs[i]->codec, codecs[i]->revision);
 		}
 		
 		if (suitable)
@@ -1022,6 +1081,211 @@ bool AlcEnabler::validateCodecs() {
 	return codecs.size() > 0;
 }
 
+CodecResource AlcEnabler::selectCodecResource(const CodecModInfo *info, uint16_t vendor, ResourcePack::Kind kind, uint32_t layout) {
+	CodecResource res;
+
+	if (ADDPR(resourcePackNum) > 0) {
+		// Every codec lives in exactly one shard
+		for (size_t p = 0; p < ADDPR(resourcePackNum); p++) {
+			auto size = *ADDPR(resourcePacks)[p].size;
+			if (size == 0)
+				continue;
+
+			auto hdr = ResourcePack::validate(ADDPR(resourcePacks)[p].data, size);
+			if (!hdr) {
+				SYSLOG("alc", "resource pack %lu is damaged", p);
+				continue;
+			}
+
+			auto e = ResourcePack::find(hdr, vendor, info->codec, kind, layout, ResourcePack::EncodingZlib, KernelPatcher::compatibleKernel);
+			if (!e) {
+				e = ResourcePack::find(hdr, vendor, info->codec, kind, layout, ResourcePack::EncodingZlibDict, KernelPatcher::compatibleKernel);
+				res.dictionary = e != nullptr;
+			}
+			if (!e) {
+				e = ResourcePack::find(hdr, vendor, info->codec, kind, layout, ResourcePack::EncodingDelta, KernelPatcher::compatibleKernel);
+				if (!e)
+					continue;
+			}
+
+			if (!ResourcePack::verify(hdr, *e)) {
+				SYSLOG("alc", "resource pack entry for %s layout %u is damaged", info->name.get(), layout);
+				return res;
+			}
+
+			// Only the selected layout is rebuilt, from then on it behaves like an inflated resource
+			if (e->encoding == ResourcePack::EncodingDelta && !rebuildDeltaResource(hdr, *e, res)) {
+				SYSLOG("alc", "failed to rebuild %s layout %u from delta", info->name.get(), layout);
+				return res;
+			}
+
+			res.data = ResourcePack::data(hdr, *e);
+			res.dataLength = e->compressedSize;
+			res.uncompressedLength = e->uncompressedSize;
+			res.layout = e->layout;
+
+			// Optional LZ4 copy is preferred when AppleHDA cannot take zlib data directly
+			e = ResourcePack::find(hdr, vendor, info->codec, kind, layout, ResourcePack::EncodingLZ4, KernelPatcher::compatibleKernel);
+			if (e && e->uncompressedSize == res.uncompressedLength && ResourcePack::verify(hdr, *e)) {
+				res.lz4Data = ResourcePack::data(hdr, *e);
+				res.lz4Length = e->compressedSize;
+			}
+
+			e = ResourcePack::find(hdr, vendor, info->codec, kind, layout, ResourcePack::EncodingBinary, KernelPatcher::compatibleKernel);
+			if (e && ResourcePack::verify(hdr, *e)) {
+				res.binaryData = ResourcePack::data(hdr, *e);
+				res.binaryLength = e->compressedSize;
+				res.binaryUncompressedLength = e->uncompressedSize;
+			}
+
+			break;
+		}
+
+		return res;
+	}
+
+	auto fi = kind == ResourcePack::KindPlatform ?
+		selectCodecFile(info->platforms.get(), info->platformNum, layout) :
+		selectCodecFile(info->layouts.get(), info->layoutNum, layout);
+	if (fi) {
+		res.data = fi->data.get();
+		res.dataLength = fi->dataLength;
+		res.layout = fi->layout;
+	}
+
+	return res;
+}
+
+bool AlcEnabler::hasCodecResources(const CodecModInfo *info, uint16_t vendor) {
+	if (info->platformNum > 0 || info->layoutNum > 0)
+		return true;
+
+	for (size_t p = 0; p < ADDPR(resourcePackNum); p++) {
+		auto size = *ADDPR(resourcePacks)[p].size;
+		auto hdr = size > 0 ? ResourcePack::validate(ADDPR(resourcePacks)[p].data, size) : nullptr;
+		if (hdr && ResourcePack::hasCodec(hdr, vendor, info->codec))
+			return true;
+	}
+
+	return false;
+}
+
+bool AlcEnabler::rebuildDeltaResource(const ResourcePack::Header *hdr, const ResourcePack::Entry &e, CodecResource &res) {
+	auto ptr = ResourcePack::data(hdr, e);
+	auto end = ptr + e.compressedSize;
+	uint64_t baseNum, scriptSize;
+	if (!ResourcePack::readVarint(ptr, end, baseNum) || !ResourcePack::readVarint(ptr, end, scriptSize) || scriptSize > UINT32_MAX)
+		return false;
+
+	auto base = ResourcePack::find(hdr, e.vendor, e.codec, ResourcePack::KindLayoutBase, static_cast<uint32_t>(baseNum), ResourcePack::EncodingZlib, KernelPatcher::compatibleKernel);
+	bool baseDictionary = base == nullptr;
+	if (!base)
+		base = ResourcePack::find(hdr, e.vendor, e.codec, ResourcePack::KindLayoutBase, static_cast<uint32_t>(baseNum), ResourcePack::EncodingZlibDict, KernelPatcher::compatibleKernel);
+	if (!base || !ResourcePack::verify(hdr, *base))
+		return false;
+
+	CodecResource baseRes;
+	baseRes.data = ResourcePack::data(hdr, *base);
+	baseRes.dataLength = base->compressedSize;
+	baseRes.uncompressedLength = base->uncompressedSize;
+	baseRes.dictionary = baseDictionary;
+
+	uint32_t baseLength = 0;
+	auto baseData = decompressCodecResource(baseRes, baseLength);
+	if (!baseData)
+		return false;
+
+	uint32_t scriptLength = static_cast<uint32_t>(scriptSize);
+	auto script = scriptLength > 0 ? Compression::decompress(Compression::ModeZLIB, &scriptLength, ptr, static_cast<uint32_t>(end - ptr), nullptr) : nullptr;
+	auto raw = Buffer::create<uint8_t>(e.uncompressedSize + 1);
+
+	bool ok = script && raw && scriptLength == scriptSize &&
+		ResourcePack::applyDelta(script, scriptLength, baseData, baseLength, raw, e.uncompressedSize) == e.uncompressedSize;
+	Buffer::deleter(baseData);
+	Buffer::deleter(script);
+	if (!ok) {
+		Buffer::deleter(raw);
+		return false;
+	}
+
+	raw[e.uncompressedSize] = '\0';
+	res.rawData = raw;
+	return true;
+}
+
+/**
+ *  ResourcePack read callback for the external resource pack
+ */
+struct ExternalPackReader {
+	const char *path;
+	bool operator()(uint64_t offset, void *buffer, size_t size) const {
+		return FileIO::readFileData(static_cast<uint8_t *>(buffer), static_cast<off_t>(offset), size, path) == 0;
+	}
+};
+
+bool AlcEnabler::loadExternalPack() {
+	ExternalPackReader read {externalPackPath};
+	ResourcePack::Header hdr {};
+	auto size = ResourcePack::readHeader(read, FileIO::readFileSize(externalPackPath), hdr);
+	if (size == 0) {
+		SYSLOG("alc", "resource pack %s is missing or damaged", externalPackPath);
+		return false;
+	}
+
+	auto index = Buffer::create<uint8_t>(size);
+	if (!index) {
+		SYSLOG("alc", "failed to allocate %lu bytes for resource pack index", size);
+		return false;
+	}
+
+	if (!ResourcePack::readIndex(read, hdr, index, size)) {
+		SYSLOG("alc", "failed to read resource pack index from %s", externalPackPath);
+		Buffer::deleter(index);
+		return false;
+	}
+
+	externalPack = index;
+	DBGLOG("alc", "loaded resource pack %s with %u entries", externalPackPath, hdr.entryNum);
+	return true;
+}
+
+const ResourcePack::Entry *AlcEnabler::findExternalResource(uint16_t vendor, uint16_t codec, ResourcePack::Kind kind, uint32_t layout) {
+	if (!externalPack)
+		return nullptr;
+	auto hdr = reinterpret_cast<const ResourcePack::Header *>(externalPack);
+	return ResourcePack::findStored(hdr, vendor, codec, kind, layout, KernelPatcher::compatibleKernel);
+}
+
+void AlcEnabler::fetchExternalResource(CodecResource &resource) {
+	auto e = resource.external;
+	if (!e)
+		return;
+	resource.external = nullptr;
+
+	auto buffer = Buffer::create<uint8_t>(e->compressedSize);
+	if (!buffer) {
+		SYSLOG("alc", "failed to allocate %u bytes for resource pack entry", e->compressedSize);
+		return;
+	}
+
+	auto hdr = reinterpret_cast<const ResourcePack::Header *>(externalPack);
+	if (!ResourcePack::readEntry(ExternalPackReader {externalPackPath}, hdr, *e, buffer)) {
+		SYSLOG("alc", "resource pack entry for layout %u is damaged, using built-in data", e->layout);
+		Buffer::deleter(buffer);
+		return;
+	}
+
+	// Copies derived from the built-in data are dropped along with it
+	Buffer::deleter(resource.plainData);
+	Buffer::deleter(resource.rawData);
+	resource = CodecResource {};
+	resource.data = resource.externalData = buffer;
+	resource.dataLength = e->compressedSize;
+	resource.uncompressedLength = e->uncompressedSize;
+	resource.layout = e->layout;
+	DBGLOG("alc", "replaced resource for layout %u with %u bytes from resource pack", e->layout, e->compressedSize);
+}
+
 bool AlcEnabler::AppleHDADriver_start(IOService *service, IOService *provider) {
 	callbackAlc->replaceAppleHDADriverResources(service);
 	
@@ -1065,21 +1329,15 @@ void AlcEnabler::replaceAppleHDADriverResources(IOService *service) {
 			SYSLOG("alc", "missing CodecModInfo for %lu codec at resource updating", i);
 			continue;
 		}
+
+		fetchExternalResource(codecs[i]->platform);
+		fetchExternalResource(codecs[i]->layout);
 		
-		size_t num = info->platformNum;
-		DBGLOG("alc", "selecting platform from %lu files", num);
-		for (size_t f = 0; f < num; f++) {
-			auto &fi = info->platforms[f];
-			DBGLOG("alc", "comparing %lu layout %X/%X", f, fi.layout, controllers[codecs[i]->controller]->layout);
-			if (controllers[codecs[i]->controller]->layout == fi.layout && KernelPatcher::compatibleKernel(fi.minKernel, fi.maxKernel)) {
-				DBGLOG("alc", "found platform at %lu index", f);
-				
-				auto dict = unserializeCodecDictionary(fi.data, fi.dataLength);
-				if (!dict) {
-					SYSLOG("alc", "failed to extract layout data");
-					break;
-				}
+		if (codecs[i]->platform) {
+			DBGLOG("alc", "found platform for layout %X", codecs[i]->platform.layout);
 
+			auto dict = unserializeCodecDictionary(codecs[i]->platform);
+			if (dict) {
 				auto pathMaps = dict->getObject("PathMaps");
 				if (pathMaps) {
 					auto pathMapsArray = OSDynamicCast(OSArray, pathMaps);
@@ -1091,26 +1349,18 @@ void AlcEnabler::replaceAppleHDADriverResources(IOService *service) {
 				} else {
 					SYSLOG("alc", "failed to get PathMaps element");
 				}
-				
+
 				dict->release();
-				break;
+			} else {
+				SYSLOG("alc", "failed to extract layout data");
 			}
 		}
-		
-		num = info->layoutNum;
-		DBGLOG("alc", "selecting layout from %lu files", num);
-		for (size_t f = 0; f < num; f++) {
-			auto &fi = info->layouts[f];
-			DBGLOG("alc", "comparing %lu layout %X/%X", f, fi.layout, controllers[codecs[i]->controller]->layout);
-			if (controllers[codecs[i]->controller]->layout == fi.layout && KernelPatcher::compatibleKernel(fi.minKernel, fi.maxKernel)) {
-				DBGLOG("alc", "found layout at %lu index", f);
-				
-				auto dict = unserializeCodecDictionary(fi.data, fi.dataLength);
-				if (!dict) {
-					SYSLOG("alc", "failed to extract platform data");
-					break;
-				}
 
+		if (codecs[i]->layout) {
+			DBGLOG("alc", "found layout for layout %X", codecs[i]->layout.layout);
+
+			auto dict = unserializeCodecDictionary(codecs[i]->layout);
+			if (dict) {
 				// Replace layout ID if a different layout ID is being reported to the OS.
 				if (layoutIdIsOverridden) {
 					auto layoutNum = OSNumber::withNumber(layoutIdOverride, 32);
@@ -1124,7 +1374,8 @@ void AlcEnabler::replaceAppleHDADriverResources(IOService *service) {
 
 				layoutsDriverArray->setObject(dict);
 				dict->release();
-				break;
+			} else {
+				SYSLOG("alc", "failed to extract platform data");
 			}
 		}
 		
@@ -1174,14 +1425,318 @@ void AlcEnabler::replaceAppleHDADriverResources(IOService *service) {
 
 	layoutsDriverArray->release();
 	pathMapsDriverArray->release();
+	releaseKeySymbols();
+}
+
+static void *zlibAlloc(void *, uInt items, uInt size) {
+	return Buffer::create<uint8_t>(static_cast<size_t>(items) * size);
 }
 
-OSDictionary* AlcEnabler::unserializeCodecDictionary(const uint8_t *data, uint32_t dataLength) {
+static void zlibFree(void *, void *ptr) {
+	Buffer::deleter(static_cast<uint8_t *>(ptr));
+}
+
+/**
+ *  Inflate a zlib stream compressed against ADDPR(resourceDictionary)
+ *
+ *  @param resource codec resource with known uncompressed length
+ *  @param length   decompressed length
+ *
+ *  @return zero terminated buffer to be freed with Buffer::deleter or nullptr
+ */
+static uint8_t *inflateWithDictionary(const CodecResource &resource, uint32_t &length) {
+	auto buffer = Buffer::create<uint8_t>(resource.uncompressedLength + 1);
+	if (!buffer) {
+		SYSLOG("alc", "failed to allocate %u bytes for dictionary resource", resource.uncompressedLength);
+		return nullptr;
+	}
+
+	z_stream zs {};
+	zs.zalloc = zlibAlloc;
+	zs.zfree = zlibFree;
+	zs.next_in = const_cast<Bytef *>(resource.data);
+	zs.avail_in = resource.dataLength;
+	zs.next_out = buffer;
+	zs.avail_out = resource.uncompressedLength;
+
+	int ret = inflateInit(&zs);
+	if (ret == Z_OK) {
+		ret = inflate(&zs, Z_FINISH);
+		if (ret == Z_NEED_DICT)
+			ret = inflateSetDictionary(&zs, ADDPR(resourceDictionary), static_cast<uInt>(ADDPR(resourceDictionarySize)));
+		if (ret == Z_OK)
+			ret = inflate(&zs, Z_FINISH);
+		length = static_cast<uint32_t>(zs.total_out);
+		inflateEnd(&zs);
+	}
+
+	if (ret != Z_STREAM_END || length != resource.uncompressedLength) {
+		SYSLOG("alc", "failed to inflate dictionary resource %d", ret);
+		Buffer::deleter(buffer);
+		return nullptr;
+	}
+
+	buffer[length] = '\0';
+	return buffer;
+}
+
+bool AlcEnabler::preparePlainZlib(CodecResource &resource) {
+	if (resource.plainData)
+		return true;
+
+	uint32_t length = 0;
+	auto raw = decompressCodecResource(resource, length);
+	if (!raw)
+		return false;
+
+	// Stored blocks cost 5 bytes per 64 KB on top of the zlib header and trailer
+	uint32_t bound = length + length / 8 + 64;
+	auto buffer = Buffer::create<uint8_t>(bound);
+	if (!buffer) {
+		SYSLOG("alc", "failed to allocate %u bytes for zlib resource", bound);
+		Buffer::deleter(raw);
+		return false;
+	}
+
+	z_stream zs {};
+	zs.zalloc = zlibAlloc;
+	zs.zfree = zlibFree;
+	zs.next_in = raw;
+	zs.avail_in = length;
+	zs.next_out = buffer;
+	zs.avail_out = bound;
+
+	int ret = deflateInit(&zs, Z_BEST_SPEED);
+	if (ret == Z_OK) {
+		ret = deflate(&zs, Z_FINISH);
+		resource.plainLength = static_cast<uint32_t>(zs.total_out);
+		deflateEnd(&zs);
+	}
+	Buffer::deleter(raw);
+
+	if (ret != Z_STREAM_END) {
+		SYSLOG("alc", "failed to re-encode dictionary resource %d", ret);
+		Buffer::deleter(buffer);
+		return false;
+	}
+
+	resource.plainData = buffer;
+	return true;
+}
+
+uint8_t *AlcEnabler::decompressCodecResource(const CodecResource &resource, uint32_t &length) {
+	if (resource.rawData) {
+		auto buffer = Buffer::create<uint8_t>(resource.uncompressedLength + 1);
+		if (!buffer) {
+			SYSLOG("alc", "failed to allocate %u bytes for rebuilt resource", resource.uncompressedLength);
+			return nullptr;
+		}
+		lilu_os_memcpy(buffer, resource.rawData, resource.uncompressedLength + 1);
+		length = resource.uncompressedLength;
+		return buffer;
+	}
+
+	if (resource.lz4Data) {
+		auto buffer = Buffer::create<uint8_t>(resource.uncompressedLength + 1);
+		if (buffer) {
+			length = static_cast<uint32_t>(ResourcePack::decodeLZ4(resource.lz4Data, resource.lz4Length, buffer, resource.uncompressedLength));
+			if (length == resource.uncompressedLength) {
+				buffer[length] = '\0';
+				return buffer;
+			}
+
+			SYSLOG("alc", "failed to decode lz4 resource, falling back to zlib");
+			Buffer::deleter(buffer);
+		} else {
+			SYSLOG("alc", "failed to allocate %u bytes for lz4 resource", resource.uncompressedLength);
+		}
+	}
+
+	if (resource.dictionary)
+		return inflateWithDictionary(resource, length);
+
+	// Buffer size that AppleHDA uses unless the exact size is known, reserve a byte for the terminator.
+	uint32_t bufferSize = resource.uncompressedLength > 0 ? resource.uncompressedLength + 1 : 0x7A000;
+	length = bufferSize;
+
+	auto buffer = Compression::decompress(Compression::ModeZLIB, &length, resource.data, resource.dataLength, nullptr);
+	if (buffer && length < bufferSize)
+		buffer[length] = '\0';
+
+	return buffer;
+}
+
+/**
+ *  Build an object from ResourcePack binary serialization
+ *
+ *  @param ptr   current position, advanced past the object
+ *  @param end   end of data
+ *  @param depth current nesting
+ *  @param keys  interned keys, nullptr when unavailable
+ *
+ *  @return retained object or nullptr
+ */
+static OSObject *unserializeBinaryObject(const uint8_t *&ptr, const uint8_t *end, size_t depth, const OSSymbol **keys) {
+	if (ptr >= end || depth >= ResourcePack::BinaryMaxDepth)
+		return nullptr;
+
+	uint64_t num;
+	const char *str;
+
+	switch (*ptr++) {
+		case ResourcePack::BinaryDict: {
+			// Every element takes at least two bytes
+			if (!ResourcePack::readVarint(ptr, end, num) || num > static_cast<uint64_t>(end - ptr))
+				return nullptr;
+			auto dict = OSDictionary::withCapacity(static_cast<uint32_t>(num));
+			if (!dict)
+				return nullptr;
+			for (uint64_t i = 0; i < num; i++) {
+				OSObject *obj = nullptr;
+				if (!ResourcePack::readString(ptr, end, str) || (obj = unserializeBinaryObject(ptr, end, depth + 1, keys)) == nullptr) {
+					dict->release();
+					return nullptr;
+				}
+				dict->setObject(str, obj);
+				obj->release();
+			}
+			return dict;
+		}
+		case ResourcePack::BinaryKeyedDict: {
+			if (!keys || !ResourcePack::readVarint(ptr, end, num) || num > static_cast<uint64_t>(end - ptr))
+				return nullptr;
+			auto dict = OSDictionary::withCapacity(static_cast<uint32_t>(num));
+			if (!dict)
+				return nullptr;
+			for (uint64_t i = 0; i < num; i++) {
+				uint64_t key;
+				OSObject *obj = nullptr;
+				if (!ResourcePack::readVarint(ptr, end, key) || key >= ADDPR(resourceKeyNum) ||
+					(obj = unserializeBinaryObject(ptr, end, depth + 1, keys)) == nullptr) {
+					dict->release();
+					return nullptr;
+				}
+				dict->setObject(keys[key], obj);
+				obj->release();
+			}
+			return dict;
+		}
+		case ResourcePack::BinaryArray: {
+			if (!ResourcePack::readVarint(ptr, end, num) || num > static_cast<uint64_t>(end - ptr))
+				return nullptr;
+			auto array = OSArray::withCapacity(static_cast<uint32_t>(num));
+			if (!array)
+				return nullptr;
+			for (uint64_t i = 0; i < num; i++) {
+				auto obj = unserializeBinaryObject(ptr, end, depth + 1, keys);
+				if (!obj) {
+					array->release();
+					return nullptr;
+				}
+				array->setObject(obj);
+				obj->release();
+			}
+			return array;
+		}
+		case ResourcePack::BinaryString:
+			if (!ResourcePack::readString(ptr, end, str))
+				return nullptr;
+			return OSString::withCString(str);
+		case ResourcePack::BinaryInteger:
+			if (!ResourcePack::readVarint(ptr, end, num))
+				return nullptr;
+			return OSNumber::withNumber(static_cast<unsigned long long>(num), 64);
+		case ResourcePack::BinaryData: {
+			if (!ResourcePack::readVarint(ptr, end, num) || num > static_cast<uint64_t>(end - ptr))
+				return nullptr;
+			auto data = OSData::withBytes(ptr, static_cast<uint32_t>(num));
+			ptr += num;
+			return data;
+		}
+		case ResourcePack::BinaryTrue:
+			return OSBoolean::withBoolean(true);
+		case ResourcePack::BinaryFalse:
+			return OSBoolean::withBoolean(false);
+		case ResourcePack::BinaryRef: {
+			// Every dictionary gets its own copy, nesting still counts against the depth limit
+			if (!ResourcePack::readVarint(ptr, end, num) || num >= ADDPR(resourceSubtreeNum))
+				return nullptr;
+			size_t start = ADDPR(resourceSubtreeOffsets)[num];
+			size_t stop = num + 1 < ADDPR(resourceSubtreeNum) ? ADDPR(resourceSubtreeOffsets)[num + 1] : ADDPR(resourceSubtreesSize);
+			if (start >= stop || stop > ADDPR(resourceSubtreesSize))
+				return nullptr;
+			auto sub = ADDPR(resourceSubtrees) + start;
+			auto obj = unserializeBinaryObject(sub, ADDPR(resourceSubtrees) + stop, depth + 1, keys);
+			if (obj && sub != ADDPR(resourceSubtrees) + stop) {
+				obj->release();
+				return nullptr;
+			}
+			return obj;
+		}
+		default:
+			return nullptr;
+	}
+}
+
+bool AlcEnabler::createKeySymbols() {
+	if (keySymbols || ADDPR(resourceKeyNum) == 0)
+		return true;
+
+	auto symbols = Buffer::create<const OSSymbol *>(ADDPR(resourceKeyNum));
+	if (!symbols) {
+		SYSLOG("alc", "failed to allocate %lu key symbols", ADDPR(resourceKeyNum));
+		return false;
+	}
+
+	for (size_t i = 0; i < ADDPR(resourceKeyNum); i++) {
+		symbols[i] = OSSymbol::withCString(reinterpret_cast<const char *>(&ADDPR(resourceKeys)[ADDPR(resourceKeyOffsets)[i]]));
+		if (!symbols[i]) {
+			SYSLOG("alc", "failed to create key symbol %lu", i);
+			while (i-- > 0)
+				symbols[i]->release();
+			Buffer::deleter(symbols);
+			return false;
+		}
+	}
+
+	keySymbols = symbols;
+	return true;
+}
+
+void AlcEnabler::releaseKeySymbols() {
+	if (!keySymbols)
+		return;
+	for (size_t i = 0; i < ADDPR(resourceKeyNum); i++)
+		keySymbols[i]->release();
+	Buffer::deleter(keySymbols);
+	keySymbols = nullptr;
+}
+
+OSDictionary* AlcEnabler::unserializeCodecDictionary(const CodecResource &resource) {
+	// Pre-serialized dictionaries avoid inflating and tokenising XML, the latter is kept as a fallback
+	if (resource.binaryData) {
+		uint32_t length = resource.binaryUncompressedLength;
+		auto binary = Compression::decompress(Compression::ModeZLIB, &length, resource.binaryData, resource.binaryLength, nullptr);
+		OSObject *obj = nullptr;
+		const uint8_t *ptr = nullptr, *end = nullptr;
+		if (binary && length == resource.binaryUncompressedLength) {
+			ptr = binary;
+			end = binary + length;
+			obj = createKeySymbols() ? unserializeBinaryObject(ptr, end, 0, keySymbols) : nullptr;
+		}
+		Buffer::deleter(binary);
+		auto dict = OSDynamicCast(OSDictionary, obj);
+		if (dict && ptr == end)
+			return dict;
+
+		OSSafeReleaseNULL(obj);
+		SYSLOG("alc", "failed to unserialize binary dictionary, falling back to XML");
+	}
+
 	OSString *errorString = nullptr;
 	OSDictionary *parsedDict = nullptr;
-	uint32_t bufferLength = 0x7A000; // Buffer size that AppleHDA uses.
-	
-	auto buffer = Compression::decompress(Compression::ModeZLIB, &bufferLength, data, dataLength, nullptr);
+	uint32_t bufferLength = 0;
+	auto buffer = decompressCodecResource(resource, bufferLength);
 	if (!buffer) {
 		return nullptr;
 	}
@@ -1221,14 +1776,24 @@ bool AlcEnabler::validateInjection(IORegistryEntry *hdaService) {
 	return !noControllerInject;
 }
 
-void AlcEnabler::applyPatches(KernelPatcher &patcher, size_t index, const KextPatch *patches, size_t patchNum) {
-	for (size_t p = 0; p < patchNum; p++) {
+void AlcEnabler::applyPatches(KernelPatcher &patcher, size_t index, const KextPatch *patches, size_t patchNum, uint32_t patchList) {
+	// Bucketed patches are already known to match the running kernel
+	size_t start = 0, end = patchNum;
+	if (patchBucket) {
+		start = patchBucket[patchList];
+		end = patchBucket[patchList + 1];
+	}
+
+	for (size_t i = start; i < end; i++) {
+		size_t p = patchBucket ? ADDPR(patchBucketIndex)[i] : i;
 		auto &patch = patches[p];
-		if (patch.patch.kext->loadIndex == index) {
-			DBGLOG("alc", "checking patch %lu for %lu kext (%s)", p, index, patch.patch.kext->id);
-			if (patcher.compatibleKernel(patch.minKernel, patch.maxKernel)) {
-				DBGLOG("alc", "applying patch %lu for %lu kext (%s)", p, index, patch.patch.kext->id);
-				patcher.applyLookupPatch(&patch.patch);
+		if (patch.kext->loadIndex == index) {
+			DBGLOG("alc", "checking patch %lu for %lu kext (%s)", p, index, patch.kext->id);
+			if (patchBucket || patcher.compatibleKernel(patch.minKernel, patch.maxKernel)) {
+				DBGLOG("alc", "applying patch %lu for %lu kext (%s)", p, index, patch.kext->id);
+				auto find = nvidiaFindOverride(static_cast<uint32_t>(&patch - ADDPR(kextPatches)));
+				KernelPatcher::LookupPatch lookup {patch.kext.get(), find ? find : patch.find.get(), patch.replace.get(), patch.size, patch.count};
+				patcher.applyLookupPatch(&lookup);
 				// Do not really care for the errors for now
 				patcher.clearError();
 			}
@@ -293,10 +293,115 @@ private:
 	/**
 	 *	Unserialize codec XML dictionary.
 	 *
-	 *	@param data				resource data
-	 *	@param dataLength	resource data length
+	 *	@param resource		compressed codec resource
 	 */
-	OSDictionary *unserializeCodecDictionary(const uint8_t *data, uint32_t dataLength);
+	OSDictionary *unserializeCodecDictionary(const CodecResource &resource);
+
+	/**
+	 *	Interned dictionary keys of binary resources, created once for all dictionaries
+	 *	built by replaceAppleHDADriverResources and released afterwards
+	 */
+	const OSSymbol **keySymbols {nullptr};
+
+	/**
+	 *	Create keySymbols unless present
+	 *
+	 *	@return true on success
+	 */
+	bool createKeySymbols();
+
+	/**
+	 *	Release keySymbols
+	 */
+	void releaseKeySymbols();
+
+	/**
+	 *	Decompress codec resource, LZ4 copy is used when available
+	 *
+	 *	@param resource		codec resource
+	 *	@param length		decompressed length
+	 *
+	 *	@return buffer to be freed with Buffer::deleter or nullptr
+	 */
+	uint8_t *decompressCodecResource(const CodecResource &resource, uint32_t &length);
+
+	/**
+	 *	Provide a zlib stream without a preset dictionary, re-encoded once on first use
+	 *
+	 *	@param resource		codec resource
+	 *
+	 *	@return true if resource.data or resource.plainData can be passed to AppleHDA
+	 */
+	bool preparePlainZlib(CodecResource &resource);
+
+	/**
+	 *	Select layout or platform resource for the running kernel
+	 *
+	 *	@param info			codec mod info
+	 *	@param vendor		codec vendor id
+	 *	@param kind			resource kind
+	 *	@param layout		layout id
+	 *
+	 *	@return selected resource, empty if nothing matches
+	 */
+	CodecResource selectCodecResource(const CodecModInfo *info, uint16_t vendor, ResourcePack::Kind kind, uint32_t layout);
+
+	/**
+	 *	Check whether a codec has layout or platform resources for any layout-id and kernel
+	 *
+	 *	@param info			codec mod info
+	 *	@param vendor		codec vendor id
+	 *
+	 *	@return true if AppleHDA resource loading has to be routed for the codec
+	 */
+	bool hasCodecResources(const CodecModInfo *info, uint16_t vendor);
+
+	/**
+	 *	Rebuild a layout stored as a delta against its codec base layout
+	 *
+	 *	@param hdr			validated pack header
+	 *	@param e			verified delta entry
+	 *	@param res			resource receiving the rebuilt layout
+	 *
+	 *	@return true on success
+	 */
+	bool rebuildDeltaResource(const ResourcePack::Header *hdr, const ResourcePack::Entry &e, CodecResource &res);
+
+	/**
+	 *	External resource pack path from alcpack boot argument or alc-pack-path controller property
+	 */
+	char externalPackPath[256] {};
+
+	/**
+	 *	Header and index of the external resource pack, entry data stays on disk until requested
+	 */
+	uint8_t *externalPack {nullptr};
+
+	/**
+	 *	Read and validate the header and index of the external resource pack
+	 *
+	 *	@return true on success
+	 */
+	bool loadExternalPack();
+
+	/**
+	 *	Find an external resource pack entry for the running kernel
+	 *
+	 *	@param vendor		codec vendor id
+	 *	@param codec		codec id
+	 *	@param kind			resource kind
+	 *	@param layout		layout id
+	 *
+	 *	@return entry or nullptr
+	 */
+	const ResourcePack::Entry *findExternalResource(uint16_t vendor, uint16_t codec, ResourcePack::Kind kind, uint32_t layout);
+
+	/**
+	 *	Replace a resource with its external pack entry on first use, built-in data is kept on failure
+	 *
+	 *	@param resource		codec resource
+	 */
+	void fetchExternalResource(CodecResource &resource);
 	
 	/**
 	 * Layout ID override
@@ -326,8 +431,14 @@ private:
 	 *  @param index      kinfo index
 	 *  @param patches    patch list
 	 *  @param patchesNum patch number
+	 *  @param patchList  patch list id in patch buckets
 	 */
-	void applyPatches(KernelPatcher &patcher, size_t index, const KextPatch *patches, size_t patchesNum);
+	void applyPatches(KernelPatcher &patcher, size_t index, const KextPatch *patches, size_t patchesNum, uint32_t patchList);
+
+	/**
+	 *  Patch bucket starts for the running kernel, nullptr when it predates the buckets
+	 */
+	const uint32_t *patchBucket {nullptr};
 
 	/**
 	 *  Controller identification and modification info
@@ -385,8 +496,19 @@ private:
 		static CodecInfo *create(size_t ctrl, uint32_t ven, uint32_t rev) {
 			return new CodecInfo(ctrl, ven, rev);
 		}
-		static void deleter(CodecInfo *info) { delete info; }
+		static void deleter(CodecInfo *info) {
+			Buffer::deleter(info->platform.plainData);
+			Buffer::deleter(info->layout.plainData);
+			Buffer::deleter(info->platform.rawData);
+			Buffer::deleter(info->layout.rawData);
+			Buffer::deleter(info->platform.externalData);
+			Buffer::deleter(info->layout.externalData);
+			delete info;
+		}
 		const CodecModInfo *info {nullptr};
+		CodecResource platform;
+		CodecResource layout;
+		bool hasResources {false};
 		size_t controller;
 		uint16_t vendor;
 		uint16_t codec;
@@ -470,6 +592,28 @@ private:
 	 *  Current NVIDIA device-id patch to use
 	 */
 	size_t currentFreeNvidiaDeviceId = 0;
+
+	/**
+	 *  Generated patches whose NvidiaSpecialFind was assigned a device-id from the list above
+	 */
+	uint32_t nvidiaPatchIndex[MaxNvidiaDeviceIds] {};
+	size_t nvidiaPatchDeviceId[MaxNvidiaDeviceIds] {};
+	size_t nvidiaPatchNum = 0;
+
+	/**
+	 *  Find bytes assigned to a generated patch, generated patches themselves are read-only
+	 *
+	 *  @param patch  ADDPR(kextPatches) index
+	 *
+	 *  @return device-id bytes or nullptr
+	 */
+	const uint8_t *nvidiaFindOverride(uint32_t patch) const {
+		for (size_t i = 0; i < nvidiaPatchNum; i++) {
+			if (nvidiaPatchIndex[i] == patch)
+				return reinterpret_cast<const uint8_t *>(&nvidiaDeviceIdList[nvidiaPatchDeviceId[i]]);
+		}
+		return nullptr;
+	}
 };
 
 #endif /* kern_alc_hpp */
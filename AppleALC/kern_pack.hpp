@@ -0,0 +1,518 @@
+//
+//  kern_pack.hpp
+//  AppleALC
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+
+// Binary resource pack layout shared by ResourceConverter and the kext.
+// This header must stay free of kernel and Lilu dependencies.
+
+#ifndef kern_pack_hpp
+#define kern_pack_hpp
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace ResourcePack {
+
+/**
+ *  'ALCP' in little endian
+ */
+static constexpr uint32_t Magic {0x50434C41};
+static constexpr uint32_t Version {1};
+
+/**
+ *  Same value as KernelPatcher::KernelAny
+ */
+static constexpr uint32_t KernelAny {0};
+
+/**
+ *  Same value as KernelVersion::SnowLeopard, the last kernel unserializing dictionaries in AppleALC
+ */
+static constexpr uint32_t KernelSnowLeopard {10};
+
+/**
+ *  Resource kinds stored in the pack
+ */
+enum Kind : uint16_t {
+	KindPlatform = 0,
+	KindLayout = 1,
+	KindLayoutBase = 2
+};
+
+/**
+ *  Entry data encodings
+ *  Every entry has either a zlib or a zlib dictionary stream, the latter needs the preset
+ *  dictionary stored next to the packs. LZ4 entries are optional copies for paths that inflate at boot.
+ *  Binary entries are zlib compressed and limited to kernels up to KernelSnowLeopard.
+ */
+enum Encoding : uint16_t {
+	EncodingZlib = 0,
+	EncodingLZ4 = 1,
+	EncodingBinary = 2,
+	EncodingZlibDict = 3,
+	EncodingDelta = 4
+};
+
+/**
+ *  Layouts of one codec may be stored as deltas against a shared KindLayoutBase entry,
+ *  its layout field numbers the bases of the codec. A delta entry holds:
+ *  base number, script size, zlib compressed script (varints unless stated otherwise).
+ *  Script ops are a varint length << 1 | op followed by a base offset for DeltaCopy
+ *  or by length literal bytes for DeltaInsert.
+ */
+enum DeltaOp : uint8_t {
+	DeltaCopy = 0,
+	DeltaInsert = 1
+};
+
+/**
+ *  Pre-serialized dictionary used instead of OSUnserializeXML on legacy paths
+ *  Every object starts with a type byte, counts and lengths are LEB128 varints.
+ *  Strings and dictionary keys are followed by a terminating zero byte.
+ */
+enum BinaryType : uint8_t {
+	BinaryDict = 1,    // count, count * (key, object)
+	BinaryArray = 2,   // count, count * object
+	BinaryString = 3,  // length, bytes, 0
+	BinaryInteger = 4, // 64-bit value
+	BinaryData = 5,    // length, bytes
+	BinaryTrue = 6,
+	BinaryFalse = 7,
+	BinaryRef = 8,     // index of a shared subtree, expanded in place
+	BinaryKeyedDict = 9 // count, count * (key index, object), keys come from the shared key table
+};
+
+/**
+ *  Maximum nesting of binary objects accepted by decoders
+ */
+static constexpr size_t BinaryMaxDepth {32};
+
+/**
+ *  Pack header, followed by the entry index and the data region
+ */
+struct Header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entryNum;
+	uint32_t entryOffset;
+	uint32_t dataOffset;
+	uint32_t dataSize;
+};
+
+/**
+ *  Index entry, sorted by vendor, codec, kind and layout
+ *  Entries sharing a key keep their Info.plist order, the first compatible one wins.
+ */
+struct Entry {
+	uint16_t vendor;
+	uint16_t codec;
+	uint16_t kind;
+	uint16_t encoding;
+	uint32_t layout;
+	uint32_t minKernel;
+	uint32_t maxKernel;
+	uint32_t offset;
+	uint32_t compressedSize;
+	uint32_t uncompressedSize;
+	uint32_t checksum;
+};
+
+static_assert(sizeof(Header) == 24, "Unexpected pack header size");
+static_assert(sizeof(Entry) == 36, "Unexpected pack entry size");
+
+/**
+ *  Adler-32 checksum of the stored entry bytes
+ */
+inline uint32_t checksum(const uint8_t *data, size_t size) {
+	uint32_t a {1}, b {0};
+	while (size > 0) {
+		size_t n = size < 5552 ? size : 5552;
+		size -= n;
+		while (n-- > 0) {
+			a += *data++;
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+	}
+	return b << 16 | a;
+}
+
+/**
+ *  Validate pack header and index bounds
+ *
+ *  @param pack pack contents
+ *  @param size pack size
+ *
+ *  @return header or nullptr
+ */
+inline const Header *validate(const uint8_t *pack, size_t size) {
+	if (!pack || size < sizeof(Header) || reinterpret_cast<uintptr_t>(pack) % alignof(Entry) != 0)
+		return nullptr;
+	auto hdr = reinterpret_cast<const Header *>(pack);
+	if (hdr->magic != Magic || hdr->version != Version || hdr->entryOffset % alignof(Entry) != 0)
+		return nullptr;
+	if (hdr->entryOffset > size || hdr->entryNum > (size - hdr->entryOffset) / sizeof(Entry))
+		return nullptr;
+	if (hdr->dataOffset > size || hdr->dataSize > size - hdr->dataOffset)
+		return nullptr;
+	return hdr;
+}
+
+/**
+ *  Index size of a pack read from a file piece by piece, header included
+ *  Such packs keep the index right after the header, only the header and the index are read upfront.
+ *
+ *  @param hdr      pack header
+ *  @param fileSize pack file size
+ *
+ *  @return index size or 0 if the header is invalid
+ */
+inline size_t indexSize(const Header &hdr, size_t fileSize) {
+	if (fileSize < sizeof(Header) || hdr.magic != Magic || hdr.version != Version || hdr.entryOffset != sizeof(Header))
+		return 0;
+	if (hdr.entryNum > (fileSize - sizeof(Header)) / sizeof(Entry))
+		return 0;
+	size_t size = sizeof(Header) + hdr.entryNum * sizeof(Entry);
+	if (hdr.dataOffset < size || hdr.dataOffset > fileSize || hdr.dataSize > fileSize - hdr.dataOffset)
+		return 0;
+	return size;
+}
+
+/**
+ *  Check that the entry points inside the data region
+ */
+inline bool contains(const Header *hdr, const Entry &e) {
+	return e.offset <= hdr->dataSize && e.compressedSize <= hdr->dataSize - e.offset;
+}
+
+/**
+ *  Check that the entry points inside the data region and matches its checksum
+ */
+inline bool verify(const Header *hdr, const Entry &e) {
+	if (!contains(hdr, e))
+		return false;
+	auto data = reinterpret_cast<const uint8_t *>(hdr) + hdr->dataOffset + e.offset;
+	return checksum(data, e.compressedSize) == e.checksum;
+}
+
+/**
+ *  Entry data pointer, entry must be verified first
+ */
+inline const uint8_t *data(const Header *hdr, const Entry &e) {
+	return reinterpret_cast<const uint8_t *>(hdr) + hdr->dataOffset + e.offset;
+}
+
+/**
+ *  Find the first entry for a codec resource accepted by the kernel check
+ *
+ *  @param hdr        validated pack header
+ *  @param vendor     codec vendor id
+ *  @param codec      codec id
+ *  @param kind       resource kind
+ *  @param layout     layout id
+ *  @param encoding   data encoding
+ *  @param compatible bool(uint32_t minKernel, uint32_t maxKernel)
+ *
+ *  @return entry or nullptr
+ */
+template <typename T>
+inline const Entry *find(const Header *hdr, uint16_t vendor, uint16_t codec, uint16_t kind, uint32_t layout, uint16_t encoding, T compatible) {
+	auto entries = reinterpret_cast<const Entry *>(reinterpret_cast<const uint8_t *>(hdr) + hdr->entryOffset);
+	auto less = [&](const Entry &e) {
+		if (e.vendor != vendor) return e.vendor < vendor;
+		if (e.codec != codec) return e.codec < codec;
+		if (e.kind != kind) return e.kind < kind;
+		return e.layout < layout;
+	};
+
+	size_t l = 0, r = hdr->entryNum;
+	while (l < r) {
+		size_t m = l + (r - l) / 2;
+		if (less(entries[m]))
+			l = m + 1;
+		else
+			r = m;
+	}
+
+	for (; l < hdr->entryNum; l++) {
+		auto &e = entries[l];
+		if (e.vendor != vendor || e.codec != codec || e.kind != kind || e.layout != layout)
+			break;
+		if (e.encoding == encoding && compatible(e.minKernel, e.maxKernel))
+			return &e;
+	}
+
+	return nullptr;
+}
+
+/**
+ *  Check whether the pack has entries of any kind and layout for a codec
+ *
+ *  @param hdr        validated pack header
+ *  @param vendor     codec vendor id
+ *  @param codec      codec id
+ *
+ *  @return true if at least one entry is present
+ */
+inline bool hasCodec(const Header *hdr, uint16_t vendor, uint16_t codec) {
+	auto entries = reinterpret_cast<const Entry *>(reinterpret_cast<const uint8_t *>(hdr) + hdr->entryOffset);
+	size_t l = 0, r = hdr->entryNum;
+	while (l < r) {
+		size_t m = l + (r - l) / 2;
+		if (entries[m].vendor < vendor || (entries[m].vendor == vendor && entries[m].codec < codec))
+			l = m + 1;
+		else
+			r = m;
+	}
+	return l < hdr->entryNum && entries[l].vendor == vendor && entries[l].codec == codec;
+}
+
+/**
+ *  Check that the index is sorted by vendor, codec, kind and layout as find expects
+ */
+inline bool sorted(const Header *hdr) {
+	auto entries = reinterpret_cast<const Entry *>(reinterpret_cast<const uint8_t *>(hdr) + hdr->entryOffset);
+	for (size_t i = 1; i < hdr->entryNum; i++) {
+		auto &a = entries[i - 1], &b = entries[i];
+		if (a.vendor != b.vendor) {
+			if (a.vendor > b.vendor) return false;
+		} else if (a.codec != b.codec) {
+			if (a.codec > b.codec) return false;
+		} else if (a.kind != b.kind) {
+			if (a.kind > b.kind) return false;
+		} else if (a.layout > b.layout) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ *  Read and check the header of a pack file
+ *  Pack files are read piece by piece through a bool(uint64_t offset, void *buffer, size_t size)
+ *  callback, only the header and the index stay in memory and buffers come from the caller.
+ *
+ *  @param read     read callback
+ *  @param fileSize pack file size
+ *  @param hdr      pack header
+ *
+ *  @return index size for readIndex or 0 on failure
+ */
+template <typename T>
+inline size_t readHeader(T read, size_t fileSize, Header &hdr) {
+	if (fileSize < sizeof(Header) || !read(0, &hdr, sizeof(Header)))
+		return 0;
+	return indexSize(hdr, fileSize);
+}
+
+/**
+ *  Read the index of a pack file, the header is read again with it and must not change in between
+ *
+ *  @param read     read callback
+ *  @param hdr      header checked by readHeader
+ *  @param index    index buffer aligned for Entry
+ *  @param size     index size returned by readHeader
+ *
+ *  @return header at the start of index or nullptr on failure
+ */
+template <typename T>
+inline const Header *readIndex(T read, const Header &hdr, uint8_t *index, size_t size) {
+	if (!index || reinterpret_cast<uintptr_t>(index) % alignof(Entry) != 0 || !read(0, index, size))
+		return nullptr;
+	auto copy = reinterpret_cast<const Header *>(index);
+	if (copy->magic != hdr.magic || copy->version != hdr.version || copy->entryNum != hdr.entryNum ||
+		copy->entryOffset != hdr.entryOffset || copy->dataOffset != hdr.dataOffset || copy->dataSize != hdr.dataSize)
+		return nullptr;
+	return sorted(copy) ? copy : nullptr;
+}
+
+/**
+ *  Find a plain zlib entry of a pack file accepted by the kernel check
+ *  Pack files are used without the built-in tables, other encodings depend on them.
+ *
+ *  @param hdr        header returned by readIndex
+ *  @param vendor     codec vendor id
+ *  @param codec      codec id
+ *  @param kind       resource kind
+ *  @param layout     layout id
+ *  @param compatible bool(uint32_t minKernel, uint32_t maxKernel)
+ *
+ *  @return entry inside the data region or nullptr
+ */
+template <typename T>
+inline const Entry *findStored(const Header *hdr, uint16_t vendor, uint16_t codec, uint16_t kind, uint32_t layout, T compatible) {
+	auto e = find(hdr, vendor, codec, kind, layout, EncodingZlib, compatible);
+	return e && contains(hdr, *e) ? e : nullptr;
+}
+
+/**
+ *  Read entry data of a pack file and check its checksum
+ *
+ *  @param read     read callback
+ *  @param hdr      header returned by readIndex
+ *  @param e        entry returned by findStored
+ *  @param buffer   buffer of e.compressedSize bytes
+ *
+ *  @return true on success
+ */
+template <typename T>
+inline bool readEntry(T read, const Header *hdr, const Entry &e, uint8_t *buffer) {
+	if (!contains(hdr, e) || !read(static_cast<uint64_t>(hdr->dataOffset) + e.offset, buffer, e.compressedSize))
+		return false;
+	return checksum(buffer, e.compressedSize) == e.checksum;
+}
+
+/**
+ *  Read a LEB128 varint
+ *
+ *  @param ptr   current position, advanced on success
+ *  @param end   end of data
+ *  @param value decoded value
+ *
+ *  @return true on success
+ */
+inline bool readVarint(const uint8_t *&ptr, const uint8_t *end, uint64_t &value) {
+	value = 0;
+	for (uint32_t shift = 0; ptr < end && shift < 64; shift += 7) {
+		uint8_t b = *ptr++;
+		value |= static_cast<uint64_t>(b & 0x7F) << shift;
+		if (!(b & 0x80))
+			return true;
+	}
+	return false;
+}
+
+/**
+ *  Read a zero-terminated binary string
+ *
+ *  @param ptr   current position, advanced on success
+ *  @param end   end of data
+ *  @param str   string start
+ *
+ *  @return true on success
+ */
+inline bool readString(const uint8_t *&ptr, const uint8_t *end, const char *&str) {
+	uint64_t len;
+	if (!readVarint(ptr, end, len) || len >= static_cast<uint64_t>(end - ptr) || ptr[len] != '\0')
+		return false;
+	str = reinterpret_cast<const char *>(ptr);
+	ptr += len + 1;
+	return true;
+}
+
+/**
+ *  Rebuild a document from its delta script
+ *
+ *  @param script    delta script
+ *  @param scriptLen delta script size
+ *  @param base      base document
+ *  @param baseLen   base document size
+ *  @param dst       output buffer
+ *  @param dstLen    output buffer size
+ *
+ *  @return rebuilt size or 0 on malformed input
+ */
+inline size_t applyDelta(const uint8_t *script, size_t scriptLen, const uint8_t *base, size_t baseLen, uint8_t *dst, size_t dstLen) {
+	auto ptr = script, end = script + scriptLen;
+	const uint8_t *src;
+	size_t size {0};
+
+	while (ptr < end) {
+		uint64_t op, len, from;
+		if (!readVarint(ptr, end, op))
+			return 0;
+		len = op >> 1;
+		if (len > dstLen - size)
+			return 0;
+
+		if ((op & 1) == DeltaCopy) {
+			if (!readVarint(ptr, end, from) || from > baseLen || len > baseLen - from)
+				return 0;
+			src = base + from;
+		} else {
+			if (len > static_cast<uint64_t>(end - ptr))
+				return 0;
+			src = ptr;
+			ptr += len;
+		}
+
+		for (size_t i = 0; i < len; i++)
+			dst[size + i] = src[i];
+		size += len;
+	}
+
+	return size;
+}
+
+/**
+ *  Decode an LZ4 block
+ *
+ *  @param src    compressed data
+ *  @param srcLen compressed size
+ *  @param dst    output buffer
+ *  @param dstLen output buffer size
+ *
+ *  @return decoded size or 0 on malformed input
+ */
+inline size_t decodeLZ4(const uint8_t *src, size_t srcLen, uint8_t *dst, size_t dstLen) {
+	auto ip = src, iend = src + srcLen;
+	auto op = dst, oend = dst + dstLen;
+
+	while (ip < iend) {
+		size_t token = *ip++;
+
+		size_t literals = token >> 4;
+		if (literals == 15) {
+			uint8_t b;
+			do {
+				if (ip >= iend)
+					return 0;
+				b = *ip++;
+				literals += b;
+			} while (b == 255);
+		}
+
+		if (literals > static_cast<size_t>(iend - ip) || literals > static_cast<size_t>(oend - op))
+			return 0;
+		for (size_t i = 0; i < literals; i++)
+			*op++ = *ip++;
+
+		// The last sequence has literals only
+		if (ip == iend)
+			break;
+
+		if (iend - ip < 2)
+			return 0;
+		size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > static_cast<size_t>(op - dst))
+			return 0;
+
+		size_t match = (token & 15) + 4;
+		if ((token & 15) == 15) {
+			uint8_t b;
+			do {
+				if (ip >= iend)
+					return 0;
+				b = *ip++;
+				match += b;
+			} while (b == 255);
+		}
+
+		if (match > static_cast<size_t>(oend - op))
+			return 0;
+		// Matches may overlap the output, copy bytewise
+		auto ref = op - offset;
+		for (size_t i = 0; i < match; i++)
+			*op++ = *ref++;
+	}
+
+	return op - dst;
+}
+
+}
+
+#endif /* kern_pack_hpp */
@@ -15,84 +15,408 @@
 #include <sys/types.h>
 #include <stdint.h>
 
+#include "kern_pack.hpp"
+
 #ifdef DEBUG
 #define DEBUG_STRING(x) (x)
+#define DEBUG_STRING_INDEX(x) (x)
 #else
 #define DEBUG_STRING(x) ""
+#define DEBUG_STRING_INDEX(x) 0
 #endif
 
+/**
+ *  Define a read-only byte array from a raw blob file, see ResourceConverter --incbin.
+ *  The assembler resolves the path from the compiler working directory.
+ */
+#ifdef __APPLE__
+#define RESOURCE_BLOB_SECTION ".section __TEXT,__const\n.private_extern "
+#else
+#define RESOURCE_BLOB_SECTION ".section .rodata\n.hidden "
+#endif
+#define RESOURCE_BLOB_SYMBOL(sym) xStringify(__USER_LABEL_PREFIX__) xStringify(sym)
+#define RESOURCE_BLOB(sym, path) __asm__(RESOURCE_BLOB_SECTION RESOURCE_BLOB_SYMBOL(sym) "\n.globl " RESOURCE_BLOB_SYMBOL(sym) \
+	"\n.p2align 4\n" RESOURCE_BLOB_SYMBOL(sym) ":\n.incbin \"" path "\"\n.text\n")
+
+/**
+ *  Generated tables refer to each other with 32-bit indices into arrays instead of pointers,
+ *  so that they need no relocations when the kext is linked and stay in read-only pages.
+ */
+template <typename T, T *Arena>
+struct ArenaRef {
+	uint32_t index;
+
+	T *get() const { return &Arena[index]; }
+	T *operator->() const { return get(); }
+	T &operator[](size_t i) const { return Arena[index + i]; }
+};
+
+/**
+ *  Generated resource data
+ */
+extern KernelPatcher::KextInfo ADDPR(kextList)[];
+extern const size_t ADDPR(kextListSize);
+
+/**
+ *  Find and replace bytes of every KextPatch, identical runs are shared
+ */
+extern const uint8_t ADDPR(patchArena)[];
+extern const size_t ADDPR(patchArenaSize);
+
+/**
+ *  Zero terminated mod names, empty unless DEBUG is defined
+ */
+extern const char ADDPR(stringArena)[];
+
+/**
+ *  Sorted revision lists of every mod
+ */
+extern const uint32_t ADDPR(revisionArena)[];
+
 struct KextPatch {
-	KernelPatcher::LookupPatch patch;
+	ArenaRef<KernelPatcher::KextInfo, ADDPR(kextList)> kext;
+	ArenaRef<const uint8_t, ADDPR(patchArena)> find;
+	ArenaRef<const uint8_t, ADDPR(patchArena)> replace;
+	uint32_t size;
+	uint32_t count;
 	uint32_t minKernel;
 	uint32_t maxKernel;
 };
 
+/**
+ *  Patch lists of every mod
+ */
+extern const KextPatch ADDPR(kextPatches)[];
+
 /**
  *  Corresponds to a Controllers.plist entry
  */
 struct ControllerModInfo {
 	static constexpr uint32_t PlatformAny {0};
-	const char *name;
+	ArenaRef<const char, ADDPR(stringArena)> name;
 	uint32_t vendor;
 	uint32_t device;
-	const uint32_t *revisions;
-	size_t revisionNum;
+	ArenaRef<const uint32_t, ADDPR(revisionArena)> revisions;
+	uint32_t revisionNum;
 	uint32_t platform;
 	int computerModel;
-	KextPatch *patches;
-	size_t patchNum;
+	ArenaRef<const KextPatch, ADDPR(kextPatches)> patches;
+	uint32_t patchNum;
+	uint32_t patchList;
+};
+
+/**
+ *  Candidate ControllerModInfo for a vendor and device pair
+ */
+struct ControllerCandidate {
+	static constexpr uint16_t CheckRevision {1};
+	static constexpr uint16_t CheckPlatform {2};
+	uint16_t mod;
+	uint16_t checks;
+};
+
+/**
+ *  Controller index sorted by vendor << 16 | device,
+ *  candidates are listed in Controllers.plist order
+ */
+struct ControllerLookupInfo {
+	uint32_t id;
+	uint32_t candidateStart;
+	uint32_t candidateNum;
 };
 
 #ifdef HAVE_ANALOG_AUDIO
+/**
+ *  Layout and platform files, identical files are stored once
+ */
+extern const uint8_t ADDPR(fileArena)[];
+
+struct CodecFile {
+	ArenaRef<const uint8_t, ADDPR(fileArena)> data;
+	uint32_t dataLength;
+	uint32_t minKernel;
+	uint32_t maxKernel;
+	uint32_t layout;
+};
+
+/**
+ *  Platform and layout file tables of every codec
+ */
+extern const CodecFile ADDPR(fileTable)[];
+
 /**
  *  Corresponds to Info.plist resource file of each codec
  */
 struct CodecModInfo {
-	struct File {
-		const uint8_t *data;
-		uint32_t dataLength;
-		uint32_t minKernel;
-		uint32_t maxKernel;
-		uint32_t layout;
-	};
-
-	const char *name;
+	using File = CodecFile;
+
+	ArenaRef<const char, ADDPR(stringArena)> name;
 	uint16_t codec;
-	const uint32_t *revisions;
-	size_t revisionNum;
+	ArenaRef<const uint32_t, ADDPR(revisionArena)> revisions;
+	uint32_t revisionNum;
 	
-	const File *platforms;
-	size_t platformNum;
-	const File *layouts;
-	size_t layoutNum;
-	const KextPatch *patches;
-	size_t patchNum;
+	ArenaRef<const File, ADDPR(fileTable)> platforms;
+	uint32_t platformNum;
+	ArenaRef<const File, ADDPR(fileTable)> layouts;
+	uint32_t layoutNum;
+	ArenaRef<const KextPatch, ADDPR(kextPatches)> patches;
+	uint32_t patchNum;
+	uint32_t patchList;
 };
 
+/**
+ *  Codecs of every vendor, grouped by vendor
+ */
+extern const CodecModInfo ADDPR(codecMod)[];
+
 /**
  *  Contains all the supported codecs by a specific vendor
  *  Corresponds to Vendors.plist resource file
  */
 struct VendorModInfo {
-	const char *name;
+	ArenaRef<const char, ADDPR(stringArena)> name;
 	uint16_t vendor;
-	const CodecModInfo *codecs;
-	const size_t codecsNum;
+	ArenaRef<const CodecModInfo, ADDPR(codecMod)> codecs;
+	uint32_t codecsNum;
+};
+
+extern const VendorModInfo ADDPR(vendorMod)[];
+extern const size_t ADDPR(vendorModSize);
+
+/**
+ *  Layout or platform resource selected for a codec on the running kernel
+ */
+struct CodecResource {
+	const uint8_t *data {nullptr};
+	uint32_t dataLength {0};
+	uint32_t uncompressedLength {0};
+	uint32_t layout {0};
+	const uint8_t *lz4Data {nullptr};
+	uint32_t lz4Length {0};
+	const uint8_t *binaryData {nullptr};
+	uint32_t binaryLength {0};
+	uint32_t binaryUncompressedLength {0};
+	// data needs ADDPR(resourceDictionary), plainData is its plain zlib copy owned by CodecInfo
+	bool dictionary {false};
+	uint8_t *plainData {nullptr};
+	uint32_t plainLength {0};
+	// Layout rebuilt from a ResourcePack::EncodingDelta entry, uncompressedLength bytes owned by CodecInfo
+	uint8_t *rawData {nullptr};
+	// Entry of the external resource pack replacing data on first use, externalData is its copy owned by CodecInfo
+	const ResourcePack::Entry *external {nullptr};
+	uint8_t *externalData {nullptr};
+
+	explicit operator bool() const { return data != nullptr || external != nullptr; }
+};
+
+/**
+ *  HDAConfigDefault entry index of the PinConfigs personality sorted by codec and layout
+ *  Compiled ConfigData and WakeConfigData live in ADDPR(pinConfigVerbs), zero size keeps the original.
+ *  A program replaces only the stream of the given source size and ResourcePack::checksum.
+ */
+struct PinConfigLookupInfo {
+	uint32_t codec;
+	uint32_t layout;
+	uint32_t index;
+	uint32_t configStart;
+	uint32_t configSize;
+	uint32_t configSourceSize;
+	uint32_t configSourceChecksum;
+	uint32_t wakeStart;
+	uint32_t wakeSize;
+	uint32_t wakeSourceSize;
+	uint32_t wakeSourceChecksum;
+};
+
+/**
+ *  Codec index sorted by vendor << 16 | codec
+ */
+struct CodecLookupInfo {
+	uint32_t id;
+	ArenaRef<const VendorModInfo, ADDPR(vendorMod)> vendor;
+	ArenaRef<const CodecModInfo, ADDPR(codecMod)> codec;
 };
 #endif
 
 /**
- *  Generated resource data
+ *  Check a sorted revision list, empty list matches any revision
+ *
+ *  @param revisions   sorted revisions
+ *  @param revisionNum number of revisions
+ *  @param revision    revision to look for
+ *
+ *  @return true if revision is supported
  */
-extern KernelPatcher::KextInfo ADDPR(kextList)[];
-extern const size_t ADDPR(kextListSize);
+inline bool matchRevision(const uint32_t *revisions, size_t revisionNum, uint32_t revision) {
+	if (revisionNum == 0)
+		return true;
+	size_t l = 0, r = revisionNum;
+	while (l < r) {
+		size_t m = l + (r - l) / 2;
+		if (revisions[m] < revision)
+			l = m + 1;
+		else
+			r = m;
+	}
+	return l < revisionNum && revisions[l] == revision;
+}
+
+/**
+ *  Patches valid for each kernel major version, bucket b covers kernel patchBucketMin + b,
+ *  the last bucket also covers every newer kernel.
+ *  Bucket b of patch list l lists patchBucketIndex[s[l]] .. patchBucketIndex[s[l+1]-1],
+ *  where s is patchBucketStart + b * patchListNum.
+ */
+extern const uint32_t ADDPR(patchBucketMin);
+extern const size_t ADDPR(patchBucketNum);
+extern const size_t ADDPR(patchListNum);
+extern const uint32_t ADDPR(patchBucketStart)[];
+extern const uint16_t ADDPR(patchBucketIndex)[];
 
-extern ControllerModInfo ADDPR(controllerMod)[];
+extern const ControllerModInfo ADDPR(controllerMod)[];
 extern const size_t ADDPR(controllerModSize);
 
+extern const ControllerCandidate ADDPR(controllerCandidates)[];
+extern const ControllerLookupInfo ADDPR(controllerLookup)[];
+extern const size_t ADDPR(controllerLookupSize);
+
+/**
+ *  Find controller mod candidates in the sorted controller index
+ *
+ *  @param vendor controller vendor id
+ *  @param device controller device id
+ *
+ *  @return lookup entry or nullptr
+ */
+inline const ControllerLookupInfo *lookupController(uint32_t vendor, uint32_t device) {
+	uint32_t id = (vendor & 0xFFFF) << 16 | (device & 0xFFFF);
+	size_t l = 0, r = ADDPR(controllerLookupSize);
+	while (l < r) {
+		size_t m = l + (r - l) / 2;
+		if (ADDPR(controllerLookup)[m].id < id)
+			l = m + 1;
+		else
+			r = m;
+	}
+	if (l < ADDPR(controllerLookupSize) && ADDPR(controllerLookup)[l].id == id)
+		return &ADDPR(controllerLookup)[l];
+	return nullptr;
+}
+
 #ifdef HAVE_ANALOG_AUDIO
-extern VendorModInfo ADDPR(vendorMod)[];
-extern const size_t ADDPR(vendorModSize);
+extern const CodecLookupInfo ADDPR(codecLookup)[];
+extern const size_t ADDPR(codecLookupSize);
+
+/**
+ *  Resource pack of a single generated shard
+ */
+struct ResourcePackInfo {
+	const uint8_t *data;
+	const size_t *size;
+};
+
+/**
+ *  Layouts and platforms in ResourcePack format, empty when file tables are used
+ */
+extern const ResourcePackInfo ADDPR(resourcePacks)[];
+extern const size_t ADDPR(resourcePackNum);
+
+/**
+ *  Preset dictionary of ResourcePack::EncodingZlibDict entries
+ */
+extern const uint8_t ADDPR(resourceDictionary)[];
+extern const size_t ADDPR(resourceDictionarySize);
+
+/**
+ *  PathMaps shared by several binary platform dictionaries, see ResourcePack::BinaryRef
+ *  Subtree i spans resourceSubtreeOffsets[i] up to the next offset or resourceSubtreesSize.
+ */
+extern const uint8_t ADDPR(resourceSubtrees)[];
+extern const size_t ADDPR(resourceSubtreesSize);
+extern const uint32_t ADDPR(resourceSubtreeOffsets)[];
+extern const size_t ADDPR(resourceSubtreeNum);
+
+/**
+ *  Zero terminated dictionary keys of ResourcePack::BinaryKeyedDict, key i starts at resourceKeyOffsets[i]
+ */
+extern const uint8_t ADDPR(resourceKeys)[];
+extern const uint32_t ADDPR(resourceKeyOffsets)[];
+extern const size_t ADDPR(resourceKeyNum);
+
+/**
+ *  Find codec mod info in the sorted codec index
+ *
+ *  @param vendor codec vendor id
+ *  @param codec  codec id
+ *
+ *  @return lookup entry or nullptr
+ */
+inline const CodecLookupInfo *lookupCodec(uint16_t vendor, uint16_t codec) {
+	uint32_t id = static_cast<uint32_t>(vendor) << 16 | codec;
+	size_t l = 0, r = ADDPR(codecLookupSize);
+	while (l < r) {
+		size_t m = l + (r - l) / 2;
+		if (ADDPR(codecLookup)[m].id < id)
+			l = m + 1;
+		else
+			r = m;
+	}
+	if (l < ADDPR(codecLookupSize) && ADDPR(codecLookup)[l].id == id)
+		return &ADDPR(codecLookup)[l];
+	return nullptr;
+}
+
+extern const PinConfigLookupInfo ADDPR(pinConfigLookup)[];
+extern const size_t ADDPR(pinConfigLookupSize);
+extern const uint8_t ADDPR(pinConfigVerbs)[];
+
+/**
+ *  Find the HDAConfigDefault entry index for a codec layout
+ *
+ *  @param codec  codec id, vendor << 16 | codec
+ *  @param layout layout id
+ *
+ *  @return lookup entry or nullptr
+ */
+inline const PinConfigLookupInfo *lookupPinConfig(uint32_t codec, uint32_t layout) {
+	size_t l = 0, r = ADDPR(pinConfigLookupSize);
+	while (l < r) {
+		size_t m = l + (r - l) / 2;
+		auto &e = ADDPR(pinConfigLookup)[m];
+		if (e.codec < codec || (e.codec == codec && e.layout < layout))
+			l = m + 1;
+		else
+			r = m;
+	}
+	if (l < ADDPR(pinConfigLookupSize) && ADDPR(pinConfigLookup)[l].codec == codec && ADDPR(pinConfigLookup)[l].layout == layout)
+		return &ADDPR(pinConfigLookup)[l];
+	return nullptr;
+}
+
+/**
+ *  Select a layout or platform file for the running kernel
+ *
+ *  @param files  file table sorted by layout id
+ *  @param num    number of files
+ *  @param layout layout id to look for
+ *
+ *  @return first compatible file with this layout id or nullptr
+ */
+inline const CodecModInfo::File *selectCodecFile(const CodecModInfo::File *files, size_t num, uint32_t layout) {
+	size_t l = 0, r = num;
+	while (l < r) {
+		size_t m = l + (r - l) / 2;
+		if (files[m].layout < layout)
+			l = m + 1;
+		else
+			r = m;
+	}
+	for (; l < num && files[l].layout == layout; l++) {
+		if (KernelPatcher::compatibleKernel(files[l].minKernel, files[l].maxKernel))
+			return &files[l];
+	}
+	return nullptr;
+}
 #endif
 
 extern const size_t KextIdAppleHDAController;
@@ -0,0 +1,517 @@
+//
+//  deflate.hpp
+//  ResourceConverter
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+
+// Exhaustive deflate encoder for layout and platform resources.
+// Matches are chosen by a shortest path search over all match lengths with
+// an iteratively refined cost model, the same idea zopfli is built upon.
+// Output is an ordinary zlib stream, so AppleHDA and the kext inflate it as usual.
+
+#ifndef deflate_hpp
+#define deflate_hpp
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <queue>
+#include <vector>
+#include <zlib.h>
+
+namespace Deflate {
+
+static constexpr size_t MinMatch {3};
+static constexpr size_t MaxMatch {258};
+static constexpr size_t WindowSize {32768};
+static constexpr size_t HashBits {15};
+static constexpr size_t ChainDepth {1024};
+
+static constexpr size_t LitLenNum {286};
+static constexpr size_t DistNum {30};
+static constexpr size_t CodeLenNum {19};
+static constexpr uint32_t EndOfBlock {256};
+
+static const uint16_t LengthBase[29] {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t LengthExtra[29] {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t DistBase[30] {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t DistExtra[30] {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const uint8_t CodeLenOrder[CodeLenNum] {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+static inline size_t lengthSymbol(size_t length) {
+	size_t s = 28;
+	while (LengthBase[s] > length)
+		s--;
+	return s;
+}
+
+static inline size_t distSymbol(size_t dist) {
+	size_t s = 29;
+	while (DistBase[s] > dist)
+		s--;
+	return s;
+}
+
+/**
+ *  Literal (length 1) or back reference
+ */
+struct Symbol {
+	uint16_t length;
+	uint16_t dist;
+};
+
+/**
+ *  Longer matches found at a position, each one usable for every length up to its own
+ */
+struct Match {
+	uint16_t length;
+	uint16_t dist;
+};
+
+class BitWriter {
+	std::vector<uint8_t> &out;
+	uint32_t acc {0};
+	uint32_t num {0};
+
+public:
+	explicit BitWriter(std::vector<uint8_t> &out) : out(out) {}
+
+	void write(uint32_t value, uint32_t bits) {
+		acc |= value << num;
+		num += bits;
+		while (num >= 8) {
+			out.push_back(static_cast<uint8_t>(acc));
+			acc >>= 8;
+			num -= 8;
+		}
+	}
+
+	void writeCode(uint32_t code, uint32_t bits) {
+		uint32_t rev {0};
+		for (uint32_t i = 0; i < bits; i++)
+			rev |= ((code >> i) & 1) << (bits - 1 - i);
+		write(rev, bits);
+	}
+
+	void finish() {
+		if (num > 0)
+			out.push_back(static_cast<uint8_t>(acc));
+		acc = num = 0;
+	}
+};
+
+/**
+ *  Build Huffman code lengths limited to maxBits
+ *  Frequencies are flattened until the limit holds, at least two codes are always produced.
+ */
+static void buildLengths(const uint32_t *freq, size_t num, uint32_t maxBits, uint8_t *lengths) {
+	std::vector<uint32_t> f(freq, freq + num);
+	size_t used = std::count_if(f.begin(), f.end(), [](uint32_t v) { return v > 0; });
+	for (size_t i = 0; used < 2 && i < num; i++) {
+		if (f[i] == 0) {
+			f[i] = 1;
+			used++;
+		}
+	}
+
+	while (true) {
+		std::fill(lengths, lengths + num, 0);
+		std::vector<uint64_t> weight;
+		std::vector<int32_t> parent;
+		using Node = std::pair<uint64_t, size_t>;
+		std::priority_queue<Node, std::vector<Node>, std::greater<Node>> queue;
+		std::vector<size_t> leaf(num);
+		for (size_t i = 0; i < num; i++) {
+			if (f[i] > 0) {
+				leaf[i] = weight.size();
+				queue.push({f[i], weight.size()});
+				weight.push_back(f[i]);
+				parent.push_back(-1);
+			}
+		}
+
+		while (queue.size() > 1) {
+			auto a = queue.top(); queue.pop();
+			auto b = queue.top(); queue.pop();
+			auto n = weight.size();
+			weight.push_back(a.first + b.first);
+			parent.push_back(-1);
+			parent[a.second] = parent[b.second] = static_cast<int32_t>(n);
+			queue.push({a.first + b.first, n});
+		}
+
+		uint32_t longest {0};
+		for (size_t i = 0; i < num; i++) {
+			if (f[i] > 0) {
+				uint32_t depth {0};
+				for (auto n = parent[leaf[i]]; n >= 0; n = parent[n])
+					depth++;
+				lengths[i] = static_cast<uint8_t>(depth);
+				longest = std::max(longest, depth);
+			}
+		}
+
+		if (longest <= maxBits)
+			return;
+
+		for (auto &v : f) {
+			if (v > 0)
+				v = (v + 1) / 2;
+		}
+	}
+}
+
+/**
+ *  Canonical Huffman codes for given lengths
+ */
+static void buildCodes(const uint8_t *lengths, size_t num, uint16_t *codes) {
+	uint16_t count[16] {}, next[16] {};
+	for (size_t i = 0; i < num; i++)
+		count[lengths[i]]++;
+	count[0] = 0;
+	uint16_t code {0};
+	for (size_t bits = 1; bits < 16; bits++) {
+		code = (code + count[bits - 1]) << 1;
+		next[bits] = code;
+	}
+	for (size_t i = 0; i < num; i++)
+		codes[i] = lengths[i] ? next[lengths[i]]++ : 0;
+}
+
+/**
+ *  Symbol frequencies including the end of block marker
+ */
+static void countSymbols(const uint8_t *data, const std::vector<Symbol> &symbols, uint32_t *litFreq, uint32_t *distFreq) {
+	for (auto &s : symbols) {
+		if (s.length == 1) {
+			litFreq[*data]++;
+		} else {
+			litFreq[257 + lengthSymbol(s.length)]++;
+			distFreq[distSymbol(s.dist)]++;
+		}
+		data += s.length;
+	}
+	litFreq[EndOfBlock] = 1;
+}
+
+/**
+ *  Write symbols as a single final block with dynamic Huffman codes
+ */
+static void writeBlock(const uint8_t *data, const std::vector<Symbol> &symbols, std::vector<uint8_t> &out) {
+	uint32_t litFreq[LitLenNum] {}, distFreq[DistNum] {};
+	countSymbols(data, symbols, litFreq, distFreq);
+
+	uint8_t lengths[LitLenNum + DistNum] {};
+	buildLengths(litFreq, LitLenNum, 15, lengths);
+	buildLengths(distFreq, DistNum, 15, lengths + LitLenNum);
+
+	size_t litNum = LitLenNum, distNum = DistNum;
+	while (litNum > 257 && lengths[litNum - 1] == 0)
+		litNum--;
+	while (distNum > 1 && lengths[LitLenNum + distNum - 1] == 0)
+		distNum--;
+
+	// Run length encode both code length sequences together
+	std::vector<uint8_t> seq(lengths, lengths + litNum);
+	seq.insert(seq.end(), lengths + LitLenNum, lengths + LitLenNum + distNum);
+	std::vector<std::pair<uint8_t, uint8_t>> runs;
+	for (size_t i = 0; i < seq.size(); ) {
+		auto value = seq[i];
+		size_t run = 1;
+		while (i + run < seq.size() && seq[i + run] == value)
+			run++;
+		i += run;
+		if (value == 0) {
+			while (run >= 11) {
+				auto n = std::min<size_t>(run, 138);
+				runs.push_back({18, static_cast<uint8_t>(n - 11)});
+				run -= n;
+			}
+			if (run >= 3) {
+				runs.push_back({17, static_cast<uint8_t>(run - 3)});
+				run = 0;
+			}
+		} else {
+			runs.push_back({value, 0});
+			run--;
+			while (run >= 3) {
+				auto n = std::min<size_t>(run, 6);
+				runs.push_back({16, static_cast<uint8_t>(n - 3)});
+				run -= n;
+			}
+		}
+		while (run-- > 0)
+			runs.push_back({value, 0});
+	}
+
+	uint32_t clFreq[CodeLenNum] {};
+	for (auto &r : runs)
+		clFreq[r.first]++;
+	uint8_t clLengths[CodeLenNum] {};
+	uint16_t clCodes[CodeLenNum] {};
+	buildLengths(clFreq, CodeLenNum, 7, clLengths);
+	buildCodes(clLengths, CodeLenNum, clCodes);
+
+	size_t clNum = CodeLenNum;
+	while (clNum > 4 && clLengths[CodeLenOrder[clNum - 1]] == 0)
+		clNum--;
+
+	uint16_t litCodes[LitLenNum] {}, distCodes[DistNum] {};
+	buildCodes(lengths, LitLenNum, litCodes);
+	buildCodes(lengths + LitLenNum, DistNum, distCodes);
+	auto distLengths = lengths + LitLenNum;
+
+	BitWriter bw(out);
+	bw.write(1, 1);
+	bw.write(2, 2);
+	bw.write(static_cast<uint32_t>(litNum - 257), 5);
+	bw.write(static_cast<uint32_t>(distNum - 1), 5);
+	bw.write(static_cast<uint32_t>(clNum - 4), 4);
+	for (size_t i = 0; i < clNum; i++)
+		bw.write(clLengths[CodeLenOrder[i]], 3);
+
+	for (auto &r : runs) {
+		bw.writeCode(clCodes[r.first], clLengths[r.first]);
+		if (r.first == 16)
+			bw.write(r.second, 2);
+		else if (r.first == 17)
+			bw.write(r.second, 3);
+		else if (r.first == 18)
+			bw.write(r.second, 7);
+	}
+
+	for (auto &s : symbols) {
+		if (s.length == 1) {
+			bw.writeCode(litCodes[*data], lengths[*data]);
+		} else {
+			auto ls = lengthSymbol(s.length);
+			bw.writeCode(litCodes[257 + ls], lengths[257 + ls]);
+			bw.write(static_cast<uint32_t>(s.length - LengthBase[ls]), LengthExtra[ls]);
+			auto ds = distSymbol(s.dist);
+			bw.writeCode(distCodes[ds], distLengths[ds]);
+			bw.write(static_cast<uint32_t>(s.dist - DistBase[ds]), DistExtra[ds]);
+		}
+		data += s.length;
+	}
+
+	bw.writeCode(litCodes[EndOfBlock], lengths[EndOfBlock]);
+	bw.finish();
+}
+
+/**
+ *  Collect increasingly longer matches at every position through hash chains
+ */
+static void findMatches(const uint8_t *data, size_t size, std::vector<Match> &matches, std::vector<uint32_t> &start) {
+	std::vector<int32_t> head(1 << HashBits, -1), prev(size, -1);
+	auto hash = [&](size_t p) {
+		return ((data[p] << 10) ^ (data[p + 1] << 5) ^ data[p + 2]) & ((1 << HashBits) - 1);
+	};
+
+	start.assign(size + 1, 0);
+	matches.clear();
+	for (size_t pos = 0; pos < size; pos++) {
+		start[pos] = static_cast<uint32_t>(matches.size());
+		if (size - pos < MinMatch)
+			continue;
+
+		size_t maxLen = std::min(MaxMatch, size - pos);
+		size_t best = MinMatch - 1;
+		auto h = hash(pos);
+		size_t depth {0};
+		for (auto cand = head[h]; cand >= 0 && depth < ChainDepth; cand = prev[cand], depth++) {
+			size_t dist = pos - static_cast<size_t>(cand);
+			if (dist > WindowSize)
+				break;
+			if (data[cand + best] != data[pos + best])
+				continue;
+			size_t len {0};
+			while (len < maxLen && data[cand + len] == data[pos + len])
+				len++;
+			if (len > best) {
+				best = len;
+				matches.push_back({static_cast<uint16_t>(len), static_cast<uint16_t>(dist)});
+				if (len == maxLen)
+					break;
+			}
+		}
+
+		prev[pos] = head[h];
+		head[h] = static_cast<int32_t>(pos);
+	}
+	start[size] = static_cast<uint32_t>(matches.size());
+}
+
+/**
+ *  Symbol costs in bits used by the shortest path search
+ */
+struct CostModel {
+	float literal[256];
+	float length[MaxMatch + 1];
+	float dist[DistNum];
+
+	/**
+	 *  Costs of the fixed Huffman codes, used for the first pass
+	 */
+	void initFixed() {
+		for (size_t i = 0; i < 256; i++)
+			literal[i] = i < 144 ? 8 : 9;
+		for (size_t l = MinMatch; l <= MaxMatch; l++) {
+			auto s = lengthSymbol(l);
+			length[l] = (257 + s < 280 ? 7 : 8) + LengthExtra[s];
+		}
+		for (size_t d = 0; d < DistNum; d++)
+			dist[d] = 5 + DistExtra[d];
+	}
+
+	/**
+	 *  Entropy costs of the symbols chosen by the previous pass
+	 */
+	void initFromSymbols(const uint8_t *data, const std::vector<Symbol> &symbols) {
+		uint32_t litFreq[LitLenNum] {}, distFreq[DistNum] {};
+		countSymbols(data, symbols, litFreq, distFreq);
+
+		auto bits = [](const uint32_t *freq, size_t num, float *cost) {
+			uint64_t total {0};
+			for (size_t i = 0; i < num; i++)
+				total += freq[i];
+			auto logTotal = total > 0 ? std::log2(static_cast<float>(total)) : 0.0f;
+			for (size_t i = 0; i < num; i++)
+				cost[i] = freq[i] > 0 ? logTotal - std::log2(static_cast<float>(freq[i])) : logTotal + 1;
+		};
+
+		float litCost[LitLenNum], distCost[DistNum];
+		bits(litFreq, LitLenNum, litCost);
+		bits(distFreq, DistNum, distCost);
+		for (size_t i = 0; i < 256; i++)
+			literal[i] = litCost[i];
+		for (size_t l = MinMatch; l <= MaxMatch; l++) {
+			auto s = lengthSymbol(l);
+			length[l] = litCost[257 + s] + LengthExtra[s];
+		}
+		for (size_t d = 0; d < DistNum; d++)
+			dist[d] = distCost[d] + DistExtra[d];
+	}
+};
+
+/**
+ *  Cheapest symbol sequence under the cost model
+ */
+static void shortestPath(const uint8_t *data, size_t size, const std::vector<Match> &matches, const std::vector<uint32_t> &start,
+						 const CostModel &model, std::vector<Symbol> &symbols) {
+	std::vector<float> cost(size + 1, INFINITY);
+	std::vector<Symbol> from(size + 1, Symbol {0, 0});
+	cost[0] = 0;
+
+	for (size_t i = 0; i < size; i++) {
+		auto base = cost[i];
+		auto c = base + model.literal[data[i]];
+		if (c < cost[i + 1]) {
+			cost[i + 1] = c;
+			from[i + 1] = {1, 0};
+		}
+
+		size_t len = MinMatch;
+		for (auto m = start[i]; m < start[i + 1]; m++) {
+			auto &match = matches[m];
+			auto distCost = base + model.dist[distSymbol(match.dist)];
+			for (; len <= match.length; len++) {
+				c = distCost + model.length[len];
+				if (c < cost[i + len]) {
+					cost[i + len] = c;
+					from[i + len] = {static_cast<uint16_t>(len), match.dist};
+				}
+			}
+		}
+	}
+
+	symbols.clear();
+	for (size_t i = size; i > 0; i -= from[i].length)
+		symbols.push_back(from[i]);
+	std::reverse(symbols.begin(), symbols.end());
+}
+
+/**
+ *  Raw deflate stream found by iterating the cost model
+ *
+ *  @param data       source bytes
+ *  @param size       source size
+ *  @param iterations number of cost model refinements
+ *
+ *  @return deflate stream
+ */
+static inline std::vector<uint8_t> compressRaw(const uint8_t *data, size_t size, size_t iterations) {
+	std::vector<Match> matches;
+	std::vector<uint32_t> start;
+	findMatches(data, size, matches, start);
+
+	CostModel model;
+	model.initFixed();
+
+	std::vector<uint8_t> best;
+	std::vector<Symbol> symbols;
+	for (size_t i = 0; i <= iterations; i++) {
+		shortestPath(data, size, matches, start, model, symbols);
+		std::vector<uint8_t> out;
+		writeBlock(data, symbols, out);
+		if (best.empty() || out.size() < best.size())
+			best = std::move(out);
+		model.initFromSymbols(data, symbols);
+	}
+
+	return best;
+}
+
+/**
+ *  Compress with zlib itself
+ */
+static inline std::vector<uint8_t> compressZlib(const uint8_t *data, size_t size, int strategy, int memLevel) {
+	std::vector<uint8_t> out;
+	z_stream zs {};
+	if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15, memLevel, strategy) != Z_OK)
+		return out;
+	out.resize(deflateBound(&zs, size));
+	zs.next_in = const_cast<uint8_t *>(data);
+	zs.avail_in = static_cast<uInt>(size);
+	zs.next_out = out.data();
+	zs.avail_out = static_cast<uInt>(out.size());
+	if (deflate(&zs, Z_FINISH) == Z_STREAM_END)
+		out.resize(zs.total_out);
+	else
+		out.clear();
+	deflateEnd(&zs);
+	return out;
+}
+
+/**
+ *  Smallest zlib stream out of the exhaustive encoder and every zlib strategy
+ *
+ *  @param data       source bytes
+ *  @param size       source size
+ *  @param iterations number of cost model refinements
+ *
+ *  @return zlib stream
+ */
+static inline std::vector<uint8_t> compress(const uint8_t *data, size_t size, size_t iterations) {
+	// CMF 32K window deflate, FLG maximum compression with a valid check value
+	std::vector<uint8_t> best {0x78, 0xDA};
+	auto raw = compressRaw(data, size, iterations);
+	best.insert(best.end(), raw.begin(), raw.end());
+	auto adler = adler32(adler32(0, nullptr, 0), data, static_cast<uInt>(size));
+	for (int shift = 24; shift >= 0; shift -= 8)
+		best.push_back(static_cast<uint8_t>(adler >> shift));
+
+	for (auto strategy : {Z_DEFAULT_STRATEGY, Z_FILTERED}) {
+		for (auto memLevel : {8, 9}) {
+			auto out = compressZlib(data, size, strategy, memLevel);
+			if (!out.empty() && out.size() < best.size())
+				best = std::move(out);
+		}
+	}
+
+	return best;
+}
+
+}
+
+#endif /* deflate_hpp */
@@ -10,42 +10,52 @@ echo "$(date) Start packing in ${PROJECT_DIR}"
 . "${PROJECT_DIR}/Tools/zlib_pack.command"
 echo "$(date) Done formatting"
 
-# Reformat project plists (perl part is for Xcode styling)
+# Reformat project plists like plutil -convert xml1 with Xcode styled <data>, one pass per changed file
 echo "$(date) Start formatting in ${PROJECT_DIR}"
-find "${PROJECT_DIR}/Resources" -name "*.plist" -o -name '*.xml' | xargs -P $(getconf _NPROCESSORS_ONLN) -I {} sh -c '\
-  h=$(md5 "${1}" | cut -f2 -d"=") ; \
-  if [ -f "${1}.md5" ] && [ "$(cat "${1}.md5")" = "$h" ]; then \
-#    echo "Skipped ${1}" ; \
-    continue ; \
-  else \
-    plutil -convert xml1 "${1}" || exit 1 ; \
-    curr=0 ; prev=1 ; \
-    while [ "$curr" != "$prev" ]; do \
-      prev=$(stat -f%z "${1}") ; \
-      perl -0777 -pi -e "s#(?<=<data>)([^\n\s]*)[\n\s]+([^<]*)(?=</data>)#\1\2#g" "${1}" || exit 1 ; \
-      curr=$(stat -f%z "${1}") ; \
-    done ; \
-    if [[ "${1}" != *.plist ]]; then \
-      perl -0777 -pi -e "s#(<\?xml[^>]+>\n<\!DOCTYPE[^>]+>\n<plist[^>]+>\n|</plist>\n)##g" "${1}" || exit 1 ; \
-    fi ; \
-    h=$(md5 "${1}" | cut -f2 -d"=") ; \
-    echo "$h" > "${1}.md5" || exit 1 ; \
-    echo "Reformatted ${1}" ; \
-  fi' -- {}
+"${TARGET_BUILD_DIR}/ResourceConverter" --format \
+  "${PROJECT_DIR}/Resources" \
+  "${PROJECT_DIR}/Resources.manifest" \
+  --jobs $(getconf _NPROCESSORS_ONLN) || exit 1
 echo "$(date) Done formatting"
 
+# md5(1) on macOS, md5sum elsewhere
+hash_file() {
+  if command -v md5 >/dev/null 2>&1; then
+    md5 -q "${1}"
+  else
+    md5sum "${1}" | cut -f1 -d" "
+  fi
+}
+
+# The preset dictionary is trained on demand with ResourceConverter --train-dict and kept in the tree,
+# it only pays off once the resources outgrow its size
+dict=()
+h=$(hash_file "${PROJECT_DIR}/Resources.manifest") || exit 1
+if [ -f "${PROJECT_DIR}/Resources/Dictionary.bin" ]; then
+  dict=(--dict "${PROJECT_DIR}/Resources/Dictionary.bin")
+  h="$h $(hash_file "${PROJECT_DIR}/Resources/Dictionary.bin")" || exit 1
+fi
+
+# Binary key and shared PathMaps tables are trained with ResourceConverter --train-tables and kept in the tree as well,
+# new keys and PathMaps stay inline until they are retrained
+tables=()
+if [ -f "${PROJECT_DIR}/Resources/BinaryTables.bin" ]; then
+  tables=(--tables "${PROJECT_DIR}/Resources/BinaryTables.bin")
+  h="$h $(hash_file "${PROJECT_DIR}/Resources/BinaryTables.bin")" || exit 1
+fi
+
 echo "$(date) Start building resources"
-find "${PROJECT_DIR}/Resources" -name "*.md5" -exec cat "{}" + > "${PROJECT_DIR}/Resources.tmp.md5" || exit 1
-h=$(md5 "${PROJECT_DIR}/Resources.tmp.md5")
-if [ -f "${PROJECT_DIR}/AppleALC/kern_resources.cpp" ] && [ -f "${PROJECT_DIR}/Resources.md5" ] && [ "$h" = "$(cat ${PROJECT_DIR}/Resources.md5)" ]; then
+if [ -f "${PROJECT_DIR}/AppleALC/kern_resources.cpp" ] && [ -d "${PROJECT_DIR}/AppleALC/kern_resources.blobs" ] && [ -f "${PROJECT_DIR}/Resources.md5" ] && [ "$h" = "$(cat ${PROJECT_DIR}/Resources.md5)" ]; then
   echo "Trusting existing kern_resources.cpp"
 else
-  # Remove the original resources
-  rm -f "${PROJECT_DIR}/AppleALC/kern_resources.cpp"
+  # ResourceConverter only rewrites sources whose contents change, see kern_resources.manifest
+  # Blobs are embedded with .incbin, their paths are relative to the project directory the compiler runs in
   ret=0
-  "${TARGET_BUILD_DIR}/ResourceConverter" \
+  cd "${PROJECT_DIR}" && "${TARGET_BUILD_DIR}/ResourceConverter" \
     "${PROJECT_DIR}/Resources" \
-    "${PROJECT_DIR}/AppleALC/kern_resources.cpp" || ret=1
+    "${PROJECT_DIR}/AppleALC/kern_resources.cpp" \
+    --incbin AppleALC/kern_resources.blobs \
+    --pack --binary "${tables[@]}" "${dict[@]}" --delta || ret=1
 
   if (( $ret )); then
     echo "Failed to build kern_resources.cpp"
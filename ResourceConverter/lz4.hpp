@@ -0,0 +1,127 @@
+//
+//  lz4.hpp
+//  ResourceConverter
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+
+// LZ4 block encoder for resource packs. Generation speed does not matter,
+// so matches are searched through hash chains for a better ratio.
+// The matching decoder is ResourcePack::decodeLZ4 in kern_pack.hpp.
+
+#ifndef lz4_hpp
+#define lz4_hpp
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace LZ4 {
+
+static constexpr size_t MinMatch {4};
+static constexpr size_t MaxOffset {65535};
+
+/**
+ *  The last match must start at least 12 bytes before the end,
+ *  and the last 5 bytes are always literals
+ */
+static constexpr size_t MatchLimit {12};
+static constexpr size_t LastLiterals {5};
+
+static constexpr size_t HashBits {16};
+static constexpr size_t ChainDepth {256};
+
+static inline uint32_t hash(const uint8_t *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return (v * 2654435761U) >> (32 - HashBits);
+}
+
+static inline void writeLength(std::vector<uint8_t> &out, size_t len) {
+	while (len >= 255) {
+		out.push_back(255);
+		len -= 255;
+	}
+	out.push_back(static_cast<uint8_t>(len));
+}
+
+static inline void writeSequence(std::vector<uint8_t> &out, const uint8_t *lit, size_t litLen, size_t offset, size_t matchLen) {
+	size_t ml = matchLen >= MinMatch ? matchLen - MinMatch : 0;
+	uint8_t token = static_cast<uint8_t>((litLen >= 15 ? 15 : litLen) << 4);
+	if (matchLen > 0)
+		token |= ml >= 15 ? 15 : ml;
+	out.push_back(token);
+	if (litLen >= 15)
+		writeLength(out, litLen - 15);
+	out.insert(out.end(), lit, lit + litLen);
+	if (matchLen > 0) {
+		out.push_back(static_cast<uint8_t>(offset));
+		out.push_back(static_cast<uint8_t>(offset >> 8));
+		if (ml >= 15)
+			writeLength(out, ml - 15);
+	}
+}
+
+/**
+ *  Encode data as a single LZ4 block
+ *
+ *  @param data source bytes
+ *  @param size source size
+ *
+ *  @return compressed block
+ */
+static inline std::vector<uint8_t> compress(const uint8_t *data, size_t size) {
+	std::vector<uint8_t> out;
+	out.reserve(size / 2 + 16);
+
+	size_t anchor {0};
+	if (size > MatchLimit) {
+		std::vector<int64_t> head(1 << HashBits, -1);
+		std::vector<int64_t> chain(size, -1);
+		size_t limit = size - MatchLimit;
+
+		auto insert = [&](size_t p) {
+			auto h = hash(data + p);
+			chain[p] = head[h];
+			head[h] = static_cast<int64_t>(p);
+		};
+
+		size_t pos {0};
+		while (pos < limit) {
+			size_t bestLen {0}, bestOff {0};
+			auto cand = head[hash(data + pos)];
+			for (size_t depth = 0; cand >= 0 && depth < ChainDepth; depth++, cand = chain[cand]) {
+				size_t off = pos - static_cast<size_t>(cand);
+				if (off > MaxOffset)
+					break;
+				size_t len {0}, maxLen = size - LastLiterals - pos;
+				while (len < maxLen && data[cand + len] == data[pos + len])
+					len++;
+				if (len > bestLen) {
+					bestLen = len;
+					bestOff = off;
+				}
+			}
+
+			if (bestLen < MinMatch) {
+				insert(pos);
+				pos++;
+				continue;
+			}
+
+			writeSequence(out, data + anchor, pos - anchor, bestOff, bestLen);
+			for (size_t end = pos + bestLen; pos < end; pos++) {
+				if (pos < limit)
+					insert(pos);
+			}
+			anchor = pos;
+		}
+	}
+
+	writeSequence(out, data + anchor, size - anchor, 0, 0);
+	return out;
+}
+
+}
+
+#endif /* lz4_hpp */
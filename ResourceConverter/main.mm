@@ -8,15 +8,36 @@
 //This file is a shameful terribly written copy-paste-like draft with minimal error checking if at all
 //TODO: Rewrite this completely
 
-#import <Foundation/Foundation.h>
-#import <Cocoa/Cocoa.h>
+// The converter no longer depends on Foundation and can be built on any host:
+// c++ -std=c++17 -O2 -x c++ ResourceConverter/main.mm -o ResourceConverter -lz
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <dirent.h>
+#include <sys/stat.h>
 #include <initializer_list>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
+#include <zlib.h>
+
+#include "plist.hpp"
+#include "writer.hpp"
+#include "lz4.hpp"
+#include "deflate.hpp"
+#include "md5.hpp"
+#include "verbs.hpp"
+#include "../AppleALC/kern_pack.hpp"
 
 #define SYSLOG(str, ...) printf("ResourceConverter: " str "\n", ## __VA_ARGS__)
 #define ERROR(str, ...) do { SYSLOG(str, ## __VA_ARGS__); exit(1); } while(0)
-NSString *ResourceHeader {@"\
+static const char *ResourceHeader {"\
 //                                                   \n\
 //  kern_resources.cpp                               \n\
 //  AppleALC                                         \n\
@@ -29,375 +50,2679 @@ NSString *ResourceHeader {@"\
 #include \"kern_resources.hpp\"                      \n\n"
 };
 
-static void appendFile(NSString *file, NSString *data) {
-	NSFileHandle *handle = [NSFileHandle fileHandleForUpdatingAtPath:file];
-	[handle seekToEndOfFile];
-	[handle writeData:[data dataUsingEncoding:NSUTF8StringEncoding]];
-	[handle closeFile];
+using Plist::Value;
+
+static OutputWriter out;
+
+static std::string numberOr(const Value &v, const char *fallback) {
+	return v ? std::to_string(v.integer) : std::string(fallback);
 }
 
-static NSString *makeStringList(NSString *name, size_t index, NSArray *array, NSString *type=@"char *") {
-	auto str = [[NSMutableString alloc] initWithFormat:@"static const %@ %@%zu[] { ", type, name, index];
-	
-	if ([type isEqualToString:@"char *"]) {
-		for (NSString *item in array) {
-			[str appendFormat:@"\"%@\", ", item];
+static std::vector<std::string> listDirectory(const std::string &path) {
+	std::vector<std::string> entries;
+	auto dir = opendir(path.c_str());
+	if (dir) {
+		while (auto ent = readdir(dir)) {
+			if (strcmp(ent->d_name, ".") && strcmp(ent->d_name, ".."))
+				entries.emplace_back(ent->d_name);
 		}
+		closedir(dir);
+	}
+	// Keep generated output independent of the file system order
+	std::sort(entries.begin(), entries.end());
+	return entries;
+}
+
+static bool fileExists(const std::string &path) {
+	struct stat st;
+	return stat(path.c_str(), &st) == 0;
+}
+
+/**
+ *  Worker threads for codec and shard processing, 1 keeps everything on the main thread
+ */
+static size_t jobCount {std::max(1U, std::thread::hardware_concurrency())};
+
+/**
+ *  Run fn(i) for every i below num on the worker pool
+ *  Callers store results by index, so the output does not depend on scheduling.
+ */
+template <typename T>
+static void parallelFor(size_t num, T fn) {
+	size_t workers = std::min(jobCount, num);
+	if (workers <= 1) {
+		for (size_t i = 0; i < num; i++)
+			fn(i);
+		return;
+	}
+
+	std::atomic<size_t> next {0};
+	std::vector<std::thread> threads;
+	for (size_t w = 0; w < workers; w++) {
+		threads.emplace_back([&]() {
+			for (size_t i; (i = next++) < num; )
+				fn(i);
+		});
+	}
+	for (auto &t : threads)
+		t.join();
+}
+
+static std::string makeStringList(const Value &array, const char *type="char *") {
+	std::string str;
+
+	if (!strcmp(type, "char *")) {
+		for (auto &item : array.array)
+			str += format("\"%s\", ", item.string.c_str());
 	} else {
-		for (NSNumber *item in array) {
-			[str appendFormat:@"0x%lX, ", [item unsignedLongValue]];
-		}
+		for (auto &item : array.array)
+			str += format("0x%llX, ", static_cast<unsigned long long>(item.unsignedValue()));
 	}
-	
-	[str appendString:@"};\n"];
-	
+
 	return str;
 }
 
-static NSDictionary * generateKexts(NSString *file, NSDictionary *kexts) {
-	auto kextPathsSection = [[NSMutableString alloc] initWithUTF8String:"\n// Kext section\n\n"];
-	auto kextSection = [[NSMutableString alloc] init];
-	auto kextNums = [[NSMutableDictionary alloc] init];
-	
-	[kextSection appendString:@"KernelPatcher::KextInfo ADDPR(kextList)[] {\n"];
-	
+static std::map<std::string, size_t> generateKexts(const Value &kexts) {
+	std::string kextPathsSection {"\n// Kext section\n\n"};
+	std::string kextSection;
+	std::map<std::string, size_t> kextNums;
+
+	kextSection += "KernelPatcher::KextInfo ADDPR(kextList)[] {\n";
+
 	size_t kextIndex {0};
-	
-	for (NSString *kextName in kexts) {
-		NSDictionary *kextInfo = [kexts objectForKey:kextName];
-		NSString *kextID = [kextInfo objectForKey:@"Id"];
-		NSArray *kextPaths = [kextInfo objectForKey:@"Paths"];
-
-		NSString *normKextID = [[[kextID
-								stringByReplacingOccurrencesOfString:@"com.apple.driver." withString:@""]
-								stringByReplacingOccurrencesOfString:@"com.apple.iokit." withString:@""]
-								stringByReplacingOccurrencesOfString:@"." withString:@""];
-		
-		[kextPathsSection appendString:makeStringList(@"kextPath", kextIndex, kextPaths)];
-
-		[kextPathsSection appendFormat:@"__attribute__((unused))\nconst size_t KextId%@ = %zu;\n", normKextID, kextIndex];
-		
-		[kextSection appendFormat:@"\t{ \"%@\", kextPath%zu, %lu, {false, %s}, {%s}, KernelPatcher::KextInfo::Unloaded },\n",
-			kextID, kextIndex, [kextPaths count], [kextInfo objectForKey:@"Reloadable"] ? "true" : "false", [kextInfo objectForKey:@"Detect"] ? "true" : ""];
-		
-		[kextNums setObject:[NSNumber numberWithUnsignedLongLong:kextIndex] forKey:kextName];
-		
+
+	for (auto &kext : kexts.dict) {
+		auto &kextName = kext.first;
+		auto &kextInfo = kext.second;
+		auto &kextID = kextInfo["Id"].string;
+		auto &kextPaths = kextInfo["Paths"];
+
+		std::string normKextID = kextID;
+		for (auto prefix : {"com.apple.driver.", "com.apple.iokit."}) {
+			size_t pos;
+			while ((pos = normKextID.find(prefix)) != std::string::npos)
+				normKextID.erase(pos, strlen(prefix));
+		}
+		size_t dot;
+		while ((dot = normKextID.find('.')) != std::string::npos)
+			normKextID.erase(dot, 1);
+
+		kextPathsSection += format("static const char *kextPath%s[] { %s};\n", normKextID.c_str(), makeStringList(kextPaths).c_str());
+
+		kextPathsSection += format("__attribute__((unused))\nconst size_t KextId%s = %zu;\n", normKextID.c_str(), kextIndex);
+
+		kextSection += format("\t{ \"%s\", kextPath%s, %zu, {false, %s}, {%s}, KernelPatcher::KextInfo::Unloaded },\n",
+			kextID.c_str(), normKextID.c_str(), kextPaths.count(), kextInfo["Reloadable"] ? "true" : "false", kextInfo["Detect"] ? "true" : "");
+
+		kextNums[kextName] = kextIndex;
+
 		kextIndex++;
 	}
-	
-	[kextSection appendString:@"};\n"];
-	[kextSection appendFormat:@"\nconst size_t ADDPR(kextListSize) {%lu};\n", [kexts count]];
 
-	appendFile(file, kextPathsSection);
-	appendFile(file, kextSection);
+	kextSection += "};\n";
+	kextSection += format("\nconst size_t ADDPR(kextListSize) {%zu};\n", kexts.count());
+
+	out.append(kextPathsSection);
+	out.append(kextSection);
 
 	return kextNums;
 }
 
-static NSString *generateFile(NSString *file, NSString *path, NSString *inFile) {
-	static size_t fileIndex {0};
-	static NSMutableDictionary *fileList = [[NSMutableDictionary alloc] init];
-	
-	auto fullInPath = [[NSString alloc] initWithFormat:@"%@/%@", path, inFile];
-	auto data = [[NSFileManager defaultManager] contentsAtPath:fullInPath];
-	auto bytes = static_cast<const uint8_t *>([data bytes]);
-	
-	if ([fileList objectForKey:fullInPath]) {
-		return [[NSString alloc] initWithFormat:@"file%@, %zu", [fileList objectForKey:fullInPath], [data length]];
-	}
-	
-	if (data) {
-		appendFile(file, [[NSString alloc] initWithFormat:@"static const uint8_t file%zu[] {\n", fileIndex]);
-		
-		size_t i = 0;
-		while (i < [data length]) {
-			auto outLine = [[NSMutableString alloc] initWithString:@"\t"];
-			for (size_t p = 0; p < 24 && i < [data length]; p++, i++) {
-				[outLine appendFormat:@"0x%0.2X, ", bytes[i]];
-			}
-			[outLine appendString:@"\n"];
-			appendFile(file, outLine);
-		}
-		
-		appendFile(file, [[NSString alloc] initWithFormat:@"};\n"]);
-		[fileList setValue:[NSNumber numberWithUnsignedLongLong:fileIndex] forKey:fullInPath];
-		fileIndex++;
-		return [[NSString alloc] initWithFormat:@"file%zu, %zu", fileIndex-1, [data length]];
+/**
+ *  64-bit FNV-1a over arbitrary bytes
+ */
+static uint64_t hashBytes(const uint8_t *data, size_t size) {
+	uint64_t h {0xCBF29CE484222325ULL};
+	for (size_t i = 0; i < size; i++) {
+		h ^= data[i];
+		h *= 0x100000001B3ULL;
 	}
-	
-	return @"nullptr, 0";
-}
-
-static NSString *generateRevisions(NSString *file, NSDictionary *codecDict) {
-	static size_t revisionIndex {0};
-	
-	NSArray *revs = [codecDict objectForKey:@"Revisions"];
-	
-	if (revs) {
-		appendFile(file, makeStringList(@"revisions", revisionIndex, revs, @"uint32_t"));
-		revisionIndex++;
-		return [[NSString alloc] initWithFormat:@"revisions%zu, %lu", revisionIndex-1, [revs count]];
-	}
-	
-	return @"nullptr, 0";
-}
-
-static NSString *generatePlatforms(NSString *file, NSDictionary *codecDict, NSString *path) {
-	static size_t platformIndex {0};
-	
-	NSArray *plats = [[codecDict objectForKey:@"Files"] objectForKey:@"Platforms"];
-	
-	if (plats) {
-		auto pStr = [[NSMutableString alloc] initWithFormat:@"static const CodecModInfo::File platforms%zu[] {\n", platformIndex];
-		for (NSDictionary *p in plats) {
-			[pStr appendFormat:@"\t{ %@, %@, %@, %@},\n",
-			 generateFile(file, path, [p objectForKey:@"Path"]),
-			 [p objectForKey:@"MinKernel"] ?: @"KernelPatcher::KernelAny",
-			 [p objectForKey:@"MaxKernel"] ?: @"KernelPatcher::KernelAny",
-			 [p objectForKey:@"Id"]
-			];
-		}
-		[pStr appendString:@"};\n"];
-	
-		appendFile(file, pStr);
-		platformIndex++;
-		return [[NSString alloc] initWithFormat:@"platforms%zu, %lu", platformIndex-1, [plats count]];
-	}
-	
-	return @"nullptr, 0";
-}
-
-static NSString *generateLayouts(NSString *file, NSDictionary *codecDict, NSString *path) {
-	static size_t layoutIndex {0};
-	
-	NSArray *lts = [[codecDict objectForKey:@"Files"] objectForKey:@"Layouts"];
-	
-	if (lts) {
-		auto pStr = [[NSMutableString alloc] initWithFormat:@"static const CodecModInfo::File layouts%zu[] {\n", layoutIndex];
-		for (NSDictionary *p in lts) {
-			[pStr appendFormat:@"\t{ %@, %@, %@, %@ },\n",
-			 generateFile(file, path, [p objectForKey:@"Path"]),
-			 [p objectForKey:@"MinKernel"] ?: @"KernelPatcher::KernelAny",
-			 [p objectForKey:@"MaxKernel"] ?: @"KernelPatcher::KernelAny",
-			 [p objectForKey:@"Id"]
-			 ];
-		}
-		[pStr appendString:@"};\n"];
-		
-		appendFile(file, pStr);
-		layoutIndex++;
-		return [[NSString alloc] initWithFormat:@"layouts%zu, %lu", layoutIndex-1, [lts count]];
-	}
-	
-	return @"nullptr, 0";
+	return h;
 }
 
 namespace std {
 	template <>
 	struct hash<std::vector<uint8_t>> {
 		size_t operator()(const std::vector<uint8_t> &x) const {
-			auto size = x.size();
-			return size ^ (size > 0 ? x[0] : 0xFF);
+			return static_cast<size_t>(hashBytes(x.data(), x.size()));
 		}
 	};
 };
 
-static std::unordered_map<std::vector<uint8_t>, size_t> patchBufMap;
+/**
+ *  Generated tables refer to each other with indices into a few shared arrays instead of pointers,
+ *  see ArenaRef. Each arena collects initialiser lines, identical runs are stored once.
+ */
+struct TableArena {
+	std::string body;
+	size_t size {0};
+	std::unordered_map<std::string, size_t> runs;
 
-static bool lookupPatchBufIndex(const uint8_t *patch, size_t len, size_t &index) {
-	std::vector<uint8_t> k;
-	k.assign(patch, patch+len);
-	auto it = patchBufMap.find(k);
-	if (it != patchBufMap.end()) {
-		index = it->second;
-		return true;
+	/**
+	 *  Append a run of elements unless an identical one exists
+	 *
+	 *  @param lines initialiser lines of the run
+	 *  @param num   number of elements in the run
+	 *
+	 *  @return index of the first element
+	 */
+	size_t add(const std::string &lines, size_t num) {
+		auto it = runs.find(lines);
+		if (it != runs.end())
+			return it->second;
+		size_t start = size;
+		body += lines;
+		size += num;
+		runs.emplace(lines, start);
+		return start;
 	}
-	return false;
+};
+
+static TableArena stringArena;
+static TableArena revisionArena;
+static TableArena kextPatchArena;
+static TableArena fileTableArena;
+
+/**
+ *  Mod name index in ADDPR(stringArena), names only exist in DEBUG builds
+ */
+static std::string generateName(const std::string &name) {
+	return format("{ DEBUG_STRING_INDEX(%zu) }", stringArena.add(format("\t\"%s\\0\"\n", name.c_str()), name.size() + 1));
 }
 
-static void storePatchBufIndex(const uint8_t *patch, size_t len, size_t index) {
-	std::vector<uint8_t> k;
-	k.assign(patch, patch+len);
-	patchBufMap[k] = index;
+/**
+ *  Directory of raw blobs embedded with .incbin instead of array initialisers, see --incbin.
+ *  It is written verbatim into .incbin directives and must be valid from the compiler working directory.
+ */
+static std::string blobDir;
+
+/**
+ *  Emit a byte array either as an initialiser or as an assembler embedded blob file
+ *
+ *  @param w      output source
+ *  @param decl   definition up to the name, e.g. static const uint8_t
+ *  @param symbol array name
+ *  @param data   bytes
+ *  @param size   byte count
+ */
+static void appendBlob(OutputWriter &w, const char *decl, const std::string &symbol, const uint8_t *data, size_t size) {
+	if (blobDir.empty()) {
+		w.appendf("%s %s[] {\n", decl, symbol.c_str());
+		w.appendBytes(data, size);
+		w.append("};\n");
+		return;
+	}
+
+	// Blob files are named after their contents, so that a changed blob also changes the source referencing it
+	auto path = format("%s/blob_%016llx.bin", blobDir.c_str(), static_cast<unsigned long long>(hashBytes(data, size)));
+	OutputWriter blob;
+	blob.openDeferred(path);
+	blob.append(std::string(reinterpret_cast<const char *>(data), size));
+	if (!blob.close())
+		ERROR("Failed to write %s", path.c_str());
+
+	// Callers declare the symbol, kern_resources.hpp or the shard source already does
+	w.appendf("RESOURCE_BLOB(%s, \"%s\");\n", symbol.c_str(), path.c_str());
+}
+
+/**
+ *  Remove blob files no generated source refers to anymore
+ */
+static void pruneBlobs(const std::vector<std::string> &sources) {
+	std::string text;
+	for (auto &src : sources) {
+		std::vector<uint8_t> data;
+		if (Plist::readFile(src, data))
+			text.append(data.begin(), data.end());
+	}
+
+	for (auto &name : listDirectory(blobDir)) {
+		if (name.size() > 4 && name.compare(name.size() - 4, 4, ".bin") == 0 &&
+			text.find("/" + name + "\"") == std::string::npos)
+			std::remove((blobDir + "/" + name).c_str());
+	}
 }
 
-static NSString *generatePatches(NSString *file, NSArray *patches, NSDictionary *kextIndexes, long *num=nullptr, NSString *header=nullptr) {
-	static size_t patchIndex {0};
-	static size_t patchBufIndex {0};
+/**
+ *  Number of duplicate blobs replaced by a reference and bytes saved
+ */
+static size_t dedupFileNum {0};
+static size_t dedupFileBytes {0};
 
-	if (patches) {
-		auto pStr = [NSMutableString alloc];
-		pStr = header ? [pStr initWithString:header] : [pStr initWithFormat:@"static KextPatch patches%zu[] {\n", patchIndex];
-		auto pbStr = [[NSMutableString alloc] init];
-		for (NSDictionary *p in patches) {
-			const size_t PatchNum = 2;
-            NSData *f[PatchNum] = {[p objectForKey:@"Find"], [p objectForKey:@"Replace"]};
-			size_t patchBufIndexes[PatchNum] {};
-			
-			if ([f[0] length] != [f[1] length]) {
-				[pStr appendString:@"#error not matching patch lengths\n"];
-				continue;
+/**
+ *  Layout and platform files of ADDPR(fileArena) and their offsets
+ */
+static std::vector<uint8_t> fileArena;
+
+static std::string generateFile(const std::string &path, const std::string &inFile) {
+	static std::map<std::string, std::pair<size_t, size_t>> fileList;
+	static std::unordered_map<std::string, size_t> contentList;
+
+	auto fullInPath = path + "/" + inFile;
+
+	auto it = fileList.find(fullInPath);
+	if (it != fileList.end())
+		return format("{ %zu }, %zu", it->second.first, it->second.second);
+
+	std::vector<uint8_t> data;
+	if (Plist::readFile(fullInPath, data)) {
+		// Same layouts and platforms are often copied to different codec directories
+		std::string content(data.begin(), data.end());
+		auto same = contentList.find(content);
+		size_t offset;
+		if (same != contentList.end()) {
+			dedupFileNum++;
+			dedupFileBytes += data.size();
+			offset = same->second;
+		} else {
+			offset = fileArena.size();
+			fileArena.insert(fileArena.end(), data.begin(), data.end());
+			contentList.emplace(std::move(content), offset);
+		}
+		fileList[fullInPath] = {offset, data.size()};
+		return format("{ %zu }, %zu", offset, data.size());
+	}
+
+	return "{ 0 }, 0";
+}
+
+static std::string generateRevisions(const Value &codecDict) {
+	auto &revs = codecDict["Revisions"];
+
+	if (revs) {
+		// Kernel side looks revisions up with a binary search
+		auto sorted = revs;
+		std::sort(sorted.array.begin(), sorted.array.end(), [](const Value &a, const Value &b) {
+			return static_cast<uint32_t>(a.unsignedValue()) < static_cast<uint32_t>(b.unsignedValue());
+		});
+		auto start = revisionArena.add("\t" + makeStringList(sorted, "uint32_t") + "\n", sorted.count());
+		return format("{ %zu }, %zu", start, revs.count());
+	}
+
+	return "{ 0 }, 0";
+}
+
+/**
+ *  Resource pack output mode, layouts and platforms go to per-shard ADDPR(resourcePackN) instead of file tables
+ */
+static bool packMode {false};
+
+/**
+ *  Codec directories are spread over a fixed number of shard translation units,
+ *  the project has to list every generated source.
+ */
+static constexpr size_t ShardCount {16};
+
+/**
+ *  Revision of the generated sources, bump it whenever the shard emitter or an encoder changes
+ *  its output for the same inputs, so that shards written by an older generator are rebuilt.
+ */
+static constexpr uint32_t GeneratorRevision {1};
+
+/**
+ *  Layout or platform queued for a shard, processed in parallel with other shards
+ */
+struct PackJob {
+	std::string path;
+	const Value *file;
+	uint16_t vendor;
+	uint16_t codec;
+	ResourcePack::Kind kind;
+	std::shared_ptr<const std::vector<uint8_t>> base;
+	uint32_t baseNum;
+};
+
+struct PackShard {
+	std::vector<PackJob> jobs;
+	std::vector<ResourcePack::Entry> entries;
+	std::vector<uint8_t> data;
+	std::unordered_map<std::vector<uint8_t>, uint32_t> dataMap;
+	// Plain zlib copies of every entry for the raw pack, see packExternal
+	std::vector<ResourcePack::Entry> externalEntries;
+	std::vector<uint8_t> externalData;
+	std::unordered_map<std::vector<uint8_t>, uint32_t> externalMap;
+	uint64_t inputHash {0};
+	bool upToDate {false};
+	size_t dedupNum {0};
+	size_t dedupBytes {0};
+};
+
+static PackShard packShards[ShardCount];
+static size_t currentShard {0};
+
+/**
+ *  Add LZ4 copies of every pack entry for paths that inflate at boot
+ */
+static bool packLZ4 {false};
+
+/**
+ *  Collect a raw pack loaded by the kext at boot without the built-in dictionary, key and subtree tables
+ */
+static bool packExternal {false};
+
+/**
+ *  Add pre-serialized dictionaries of every pack entry for the legacy unserialization path
+ */
+static bool packBinary {false};
+
+/**
+ *  Store zlib entries against a preset dictionary trained over every layout and platform
+ *  The dictionary is trained by --train-dict and kept as a versioned file, so that editing
+ *  one resource does not change it and invalidate every shard.
+ */
+static bool packDict {false};
+static std::string packDictFile;
+static std::vector<uint8_t> packDictionary;
+
+/**
+ *  Dictionary file header: 'ALCD' in little endian and format version
+ */
+static constexpr uint32_t DictionaryMagic {0x44434C41};
+static constexpr uint32_t DictionaryVersion {1};
+
+/**
+ *  Store layouts of a codec as deltas against one shared base layout
+ */
+static bool packDelta {false};
+
+/**
+ *  Shortest base match worth a copy op, and match candidates checked per position
+ */
+static constexpr size_t DeltaMinMatch {8};
+static constexpr size_t DeltaMaxCandidates {16};
+
+/**
+ *  Deflate cannot reference farther back than the window size minus its lookahead
+ */
+static constexpr size_t DictionaryMaxSize {32*1024 - 262};
+
+/**
+ *  Dictionary candidates are runs of a few elements, longer ones are mostly <data> contents,
+ *  which do not repeat across documents
+ */
+static constexpr size_t DictionaryMaxRun {4};
+static constexpr size_t DictionaryMaxLine {256};
+
+static void writeVarint(std::vector<uint8_t> &out, uint64_t value) {
+	do {
+		uint8_t b = value & 0x7F;
+		value >>= 7;
+		out.push_back(value ? (b | 0x80) : b);
+	} while (value);
+}
+
+static void writeBinaryString(std::vector<uint8_t> &out, const std::string &str) {
+	if (str.find('\0') != std::string::npos)
+		throw std::runtime_error("string with zero byte");
+	writeVarint(out, str.size());
+	out.insert(out.end(), str.begin(), str.end());
+	out.push_back('\0');
+}
+
+/**
+ *  Dictionary keys of every layout and platform, most frequent first, referred to by index
+ *  The table is trained by --train-tables and kept as a versioned file, so that a new key
+ *  does not renumber the others and invalidate every shard. Dictionaries with keys missing
+ *  from the table keep them inline until it is retrained.
+ */
+static std::string packTablesFile;
+static std::vector<std::string> keyTable;
+static std::unordered_map<std::string, uint32_t> keyIds;
+
+/**
+ *  Binary tables file header: 'ALCT' in little endian and format version
+ */
+static constexpr uint32_t TablesMagic {0x54434C41};
+static constexpr uint32_t TablesVersion {2};
+
+/**
+ *  PathMaps elements found in several platforms, serialized once and referred to by index
+ *  They are trained together with the key table, so that editing one platform only changes
+ *  its own shard. PathMaps missing from the table are stored inline until it is retrained.
+ */
+static std::vector<uint8_t> sharedSubtrees;
+static std::vector<uint32_t> sharedSubtreeOffsets;
+static std::unordered_map<std::vector<uint8_t>, uint32_t> sharedSubtreeMap;
+
+/**
+ *  Serialize a property list in ResourcePack binary format, see ResourcePack::BinaryType
+ *  Dictionaries matching a shared subtree become references when shared is set.
+ */
+static void serializeBinary(const Value &v, std::vector<uint8_t> &out, size_t depth = 0, bool shared = false) {
+	if (depth >= ResourcePack::BinaryMaxDepth)
+		throw std::runtime_error("nesting is too deep");
+
+	if (shared && v.isDict() && !sharedSubtreeMap.empty()) {
+		std::vector<uint8_t> plain;
+		serializeBinary(v, plain, depth);
+		auto it = sharedSubtreeMap.find(plain);
+		if (it != sharedSubtreeMap.end()) {
+			out.push_back(ResourcePack::BinaryRef);
+			writeVarint(out, it->second);
+			return;
+		}
+	}
+
+	switch (v.type) {
+		case Value::Type::Dict:
+			if (!keyIds.empty() && std::all_of(v.dict.begin(), v.dict.end(), [](const std::pair<std::string, Value> &kv) {
+				return keyIds.count(kv.first) != 0;
+			})) {
+				out.push_back(ResourcePack::BinaryKeyedDict);
+				writeVarint(out, v.dict.size());
+				for (auto &kv : v.dict) {
+					writeVarint(out, keyIds[kv.first]);
+					serializeBinary(kv.second, out, depth + 1, shared);
+				}
+				break;
+			}
+			out.push_back(ResourcePack::BinaryDict);
+			writeVarint(out, v.dict.size());
+			for (auto &kv : v.dict) {
+				writeBinaryString(out, kv.first);
+				serializeBinary(kv.second, out, depth + 1, shared);
 			}
-			
-			for (size_t i = 0; i < PatchNum; i++) {
-				auto patchBuf = reinterpret_cast<const uint8_t *>([f[i] bytes]);
-				size_t patchLen = [f[i] length];
-				
-				if (!lookupPatchBufIndex(patchBuf, patchLen, patchBufIndexes[i])) {
-					[pbStr appendString:[[NSString alloc] initWithFormat:@"static const uint8_t patchBuf%zu[] { ", patchBufIndex]];
-					
-					for (size_t b = 0; b < patchLen; b++) {
-						[pbStr appendString:[[NSString alloc] initWithFormat:@"0x%0.2X, ", patchBuf[b]]];
-					}
-					
-					[pbStr appendString:@"};\n"];
-					
-					patchBufIndexes[i] = patchBufIndex++;
-					storePatchBufIndex(patchBuf, patchLen, patchBufIndexes[i]);
+			break;
+		case Value::Type::Array:
+			out.push_back(ResourcePack::BinaryArray);
+			writeVarint(out, v.array.size());
+			for (auto &item : v.array)
+				serializeBinary(item, out, depth + 1, shared);
+			break;
+		case Value::Type::String:
+			out.push_back(ResourcePack::BinaryString);
+			writeBinaryString(out, v.string);
+			break;
+		case Value::Type::Integer:
+			out.push_back(ResourcePack::BinaryInteger);
+			writeVarint(out, static_cast<uint64_t>(v.integer));
+			break;
+		case Value::Type::Data:
+			out.push_back(ResourcePack::BinaryData);
+			writeVarint(out, v.data.size());
+			out.insert(out.end(), v.data.begin(), v.data.end());
+			break;
+		case Value::Type::Boolean:
+			out.push_back(v.boolean ? ResourcePack::BinaryTrue : ResourcePack::BinaryFalse);
+			break;
+		default:
+			// OSUnserializeXML has no real or date support either
+			throw std::runtime_error("unsupported value type");
+	}
+}
+
+/**
+ *  Inflate a zlib stream
+ */
+static bool inflateData(const std::vector<uint8_t> &data, std::vector<uint8_t> &result) {
+	z_stream zs {};
+	if (inflateInit(&zs) != Z_OK)
+		return false;
+	uint8_t chunk[65536];
+	zs.next_in = const_cast<uint8_t *>(data.data());
+	zs.avail_in = static_cast<uInt>(data.size());
+	result.clear();
+	int ret;
+	do {
+		zs.next_out = chunk;
+		zs.avail_out = sizeof(chunk);
+		ret = inflate(&zs, Z_NO_FLUSH);
+		result.insert(result.end(), chunk, zs.next_out);
+	} while (ret == Z_OK);
+	inflateEnd(&zs);
+	return ret == Z_STREAM_END;
+}
+
+/**
+ *  Compress with zlib against the preset dictionary
+ */
+static std::vector<uint8_t> deflateWithDictionary(const std::vector<uint8_t> &raw) {
+	z_stream zs {};
+	if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, MAX_WBITS, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+		return {};
+	std::vector<uint8_t> result;
+	if (deflateSetDictionary(&zs, packDictionary.data(), static_cast<uInt>(packDictionary.size())) == Z_OK) {
+		result.resize(deflateBound(&zs, raw.size()));
+		zs.next_in = const_cast<uint8_t *>(raw.data());
+		zs.avail_in = static_cast<uInt>(raw.size());
+		zs.next_out = result.data();
+		zs.avail_out = static_cast<uInt>(result.size());
+		if (deflate(&zs, Z_FINISH) == Z_STREAM_END)
+			result.resize(zs.total_out);
+		else
+			result.clear();
+	}
+	deflateEnd(&zs);
+	return result;
+}
+
+/**
+ *  Inflate a zlib stream compressed against the preset dictionary
+ */
+static bool inflateWithDictionary(const std::vector<uint8_t> &data, std::vector<uint8_t> &result, size_t size) {
+	z_stream zs {};
+	if (inflateInit(&zs) != Z_OK)
+		return false;
+	result.resize(size + 1);
+	zs.next_in = const_cast<uint8_t *>(data.data());
+	zs.avail_in = static_cast<uInt>(data.size());
+	zs.next_out = result.data();
+	zs.avail_out = static_cast<uInt>(result.size());
+	auto ret = inflate(&zs, Z_FINISH);
+	if (ret == Z_NEED_DICT && inflateSetDictionary(&zs, packDictionary.data(), static_cast<uInt>(packDictionary.size())) == Z_OK)
+		ret = inflate(&zs, Z_FINISH);
+	result.resize(zs.total_out);
+	inflateEnd(&zs);
+	return ret == Z_STREAM_END;
+}
+
+/**
+ *  Delta script rebuilding target from base, see ResourcePack::DeltaOp
+ *  Copies come from the longest base match at each position, other bytes are inserted.
+ */
+static std::vector<uint8_t> makeDelta(const std::vector<uint8_t> &base, const std::vector<uint8_t> &target) {
+	auto gram = [](const uint8_t *p) {
+		uint64_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	};
+	static_assert(DeltaMinMatch == sizeof(uint64_t), "Grams are read as 64-bit words");
+
+	std::unordered_map<uint64_t, std::vector<uint32_t>> index;
+	for (size_t i = 0; i + DeltaMinMatch <= base.size(); i++) {
+		auto &pos = index[gram(&base[i])];
+		if (pos.size() < DeltaMaxCandidates)
+			pos.push_back(static_cast<uint32_t>(i));
+	}
+
+	std::vector<uint8_t> script;
+	size_t literal {0}, i {0};
+	auto flushLiteral = [&](size_t end) {
+		if (end > literal) {
+			writeVarint(script, (end - literal) << 1 | ResourcePack::DeltaInsert);
+			script.insert(script.end(), target.begin() + literal, target.begin() + end);
+		}
+	};
+
+	while (i + DeltaMinMatch <= target.size()) {
+		size_t bestLen {0}, bestPos {0};
+		auto it = index.find(gram(&target[i]));
+		if (it != index.end()) {
+			for (auto p : it->second) {
+				size_t len = DeltaMinMatch;
+				while (p + len < base.size() && i + len < target.size() && base[p + len] == target[i + len])
+					len++;
+				if (len > bestLen) {
+					bestLen = len;
+					bestPos = p;
 				}
 			}
-			
-			[pStr appendFormat:@"\t{ { &ADDPR(kextList)[%@], patchBuf%zu, patchBuf%zu, %zu, %@ }, %@, %@ },\n",
-			 [kextIndexes objectForKey:[p objectForKey:@"Name"]],
-			 patchBufIndexes[0],
-			 patchBufIndexes[1],
-			 [f[0] length],
-			 [p objectForKey:@"Count"] ?: @"0",
-			 [p objectForKey:@"MinKernel"] ?: @"KernelPatcher::KernelAny",
-			 [p objectForKey:@"MaxKernel"] ?: @"KernelPatcher::KernelAny"
-			];
-		}
-		[pStr appendString:@"};\n"];
-		if (num)
-			*num = [patches count];
-		
-		appendFile(file, pbStr);
-		appendFile(file, pStr);
-		patchIndex++;
-		return [[NSString alloc] initWithFormat:@"patches%zu, %lu", patchIndex-1, [patches count]];
-	}
-	
-	return @"nullptr, 0";
-}
-
-static size_t generateCodecs(NSString *file, NSString *vendor, NSString *path, NSDictionary *kextIndexes) {
-	appendFile(file, [[NSString alloc] initWithFormat:@"\n// %@ CodecMod section\n\n", vendor]);
-
-	auto codecModSection = [[NSMutableString alloc] initWithFormat:@"static CodecModInfo codecMod%@[] {\n", vendor];
-	auto fm = [NSFileManager defaultManager];
-	NSArray *entries = [fm contentsOfDirectoryAtPath:path error:nil];
-	
-	size_t codecs {0};
-	for (NSString *entry in entries) {
-		NSString *baseDirStr = [[NSString alloc] initWithFormat:@"%@/%@", path, entry];
-		NSString *infoCfgStr = [[NSString alloc] initWithFormat:@"%@/Info.plist", baseDirStr];
-		
-		// Dir exists and is codec dir
-		if ([fm fileExistsAtPath:infoCfgStr]) {
-			auto codecDict = [NSDictionary dictionaryWithContentsOfFile:infoCfgStr];
-			// Vendor match
-			if ([[codecDict objectForKey:@"Vendor"] isEqualToString:vendor]) {
-				auto revs = generateRevisions(file, codecDict);
-				auto platforms = generatePlatforms(file, codecDict, baseDirStr);
-				auto layouts = generateLayouts(file, codecDict, baseDirStr);
-				auto patches = generatePatches(file, [codecDict objectForKey:@"Patches"], kextIndexes);
-			
-				[codecModSection appendFormat:@"\t{ DEBUG_STRING(\"%@\"), 0x%X, %@, %@, %@, %@ },\n",
-				 [codecDict objectForKey:@"CodecName"],
-				 [[codecDict objectForKey:@"CodecID"] unsignedShortValue],
-				 revs, platforms, layouts, patches
-				];
-				codecs++;
+		}
+
+		if (bestLen == 0) {
+			i++;
+			continue;
+		}
+
+		flushLiteral(i);
+		writeVarint(script, bestLen << 1 | ResourcePack::DeltaCopy);
+		writeVarint(script, bestPos);
+		i += bestLen;
+		literal = i;
+	}
+
+	flushLiteral(target.size());
+	return script;
+}
+
+/**
+ *  Pick the base of every codec with several layouts, the one keeping all deltas of the codec the smallest
+ */
+static void planDeltas(PackShard &shard) {
+	std::map<std::pair<uint16_t, uint16_t>, std::vector<PackJob *>> codecs;
+	for (auto &job : shard.jobs) {
+		if (job.kind == ResourcePack::KindLayout)
+			codecs[{job.vendor, job.codec}].push_back(&job);
+	}
+
+	for (auto &c : codecs) {
+		auto &jobs = c.second;
+		if (jobs.size() < 2)
+			continue;
+
+		std::vector<std::vector<uint8_t>> raws(jobs.size());
+		for (size_t i = 0; i < jobs.size(); i++) {
+			auto fullInPath = jobs[i]->path + "/" + (*jobs[i]->file)["Path"].string;
+			std::vector<uint8_t> data;
+			if (!Plist::readFile(fullInPath, data) || !inflateData(data, raws[i]))
+				ERROR("Failed to read %s", fullInPath.c_str());
+		}
+
+		size_t best {0}, bestSize {SIZE_MAX};
+		for (size_t b = 0; b < raws.size(); b++) {
+			size_t size {0};
+			for (size_t i = 0; i < raws.size() && size < bestSize; i++)
+				size += makeDelta(raws[b], raws[i]).size();
+			if (size < bestSize) {
+				bestSize = size;
+				best = b;
 			}
 		}
+
+		auto base = std::make_shared<const std::vector<uint8_t>>(std::move(raws[best]));
+		for (auto job : jobs) {
+			job->base = base;
+			job->baseNum = 0;
+		}
 	}
-	
-	[codecModSection appendString:@"};\n"];
-	appendFile(file, codecModSection);
-	
-	return codecs;
 }
 
-static void generateControllers(NSString *file, NSArray *ctrls, NSDictionary *vendors, NSDictionary *kextIndexes) {
-	appendFile(file, @"\n// ControllerMod section\n\n");
-	
-	auto ctrlModSection = [[NSMutableString alloc] initWithString:@"ControllerModInfo ADDPR(controllerMod)[] {\n"];
-
-	for (NSDictionary *entry in ctrls) {
-		auto revs = generateRevisions(file, entry);
-		auto patches = generatePatches(file, [entry objectForKey:@"Patches"], kextIndexes);
-		
-		auto model = @"WIOKit::ComputerModel::ComputerAny";
-		if ([entry objectForKey:@"Model"]) {
-			if ([[entry objectForKey:@"Model"] isEqualToString:@"Laptop"]) {
-				model = @"WIOKit::ComputerModel::ComputerLaptop";
-			} else if ([[entry objectForKey:@"Model"] isEqualToString:@"Desktop"]) {
-				model = @"WIOKit::ComputerModel::ComputerDesktop";
+/**
+ *  Store bytes in the pack data region, identical blobs share one copy
+ */
+static uint32_t storePackData(PackShard &shard, std::vector<uint8_t> &&data) {
+	auto same = shard.dataMap.find(data);
+	if (same != shard.dataMap.end()) {
+		shard.dedupNum++;
+		shard.dedupBytes += data.size();
+		return same->second;
+	}
+
+	auto offset = static_cast<uint32_t>(shard.data.size());
+	shard.data.insert(shard.data.end(), data.begin(), data.end());
+	shard.dataMap.emplace(std::move(data), offset);
+	return offset;
+}
+
+/**
+ *  Store the base layouts of planned deltas, unless no layout ends up referring to them
+ */
+static void addDeltaBases(PackShard &shard) {
+	std::vector<std::pair<const PackJob *, bool>> bases;
+	for (auto &job : shard.jobs) {
+		if (job.base && (bases.empty() || bases.back().first->base != job.base))
+			bases.emplace_back(&job, false);
+	}
+
+	for (auto &e : shard.entries) {
+		if (e.encoding != ResourcePack::EncodingDelta)
+			continue;
+		for (auto &b : bases) {
+			if (b.first->vendor == e.vendor && b.first->codec == e.codec)
+				b.second = true;
+		}
+	}
+
+	for (auto &b : bases) {
+		if (!b.second)
+			continue;
+
+		auto &raw = *b.first->base;
+		ResourcePack::Entry e {};
+		e.vendor = b.first->vendor;
+		e.codec = b.first->codec;
+		e.kind = ResourcePack::KindLayoutBase;
+		e.encoding = ResourcePack::EncodingZlib;
+		e.layout = b.first->baseNum;
+		e.minKernel = e.maxKernel = ResourcePack::KernelAny;
+		e.uncompressedSize = static_cast<uint32_t>(raw.size());
+
+		auto data = Deflate::compressZlib(raw.data(), raw.size(), Z_DEFAULT_STRATEGY, 9);
+		if (!packDictionary.empty()) {
+			auto dictData = deflateWithDictionary(raw);
+			if (!dictData.empty() && dictData.size() < data.size()) {
+				e.encoding = ResourcePack::EncodingZlibDict;
+				data = std::move(dictData);
 			}
 		}
-				
-		[ctrlModSection appendFormat:@"\t{ DEBUG_STRING(\"%@\"), 0x%X, 0x%X, %@, %@, %@, %@ },\n",
-		 [entry objectForKey:@"Name"],
-		 [[vendors objectForKey:[entry objectForKey:@"Vendor"]] unsignedShortValue],
-		 [[entry objectForKey:@"Device"] unsignedShortValue],
-		 revs, [entry objectForKey:@"Platform"] ?: @"ControllerModInfo::PlatformAny",
-		 model, patches
-		];
+
+		e.compressedSize = static_cast<uint32_t>(data.size());
+		e.checksum = ResourcePack::checksum(data.data(), data.size());
+		e.offset = storePackData(shard, std::move(data));
+		shard.entries.push_back(e);
+	}
+}
+
+static void addPackEntry(PackShard &shard, const PackJob &job) {
+	auto &file = *job.file;
+	auto fullInPath = job.path + "/" + file["Path"].string;
+	std::vector<uint8_t> data;
+	if (!Plist::readFile(fullInPath, data))
+		ERROR("Failed to read %s", fullInPath.c_str());
+
+	std::vector<uint8_t> raw;
+	if (!inflateData(data, raw))
+		ERROR("Invalid zlib stream in %s", fullInPath.c_str());
+
+	ResourcePack::Entry e {};
+	e.vendor = job.vendor;
+	e.codec = job.codec;
+	e.kind = job.kind;
+	e.encoding = ResourcePack::EncodingZlib;
+	e.layout = static_cast<uint32_t>(file["Id"].unsignedValue());
+	e.minKernel = file["MinKernel"] ? static_cast<uint32_t>(file["MinKernel"].unsignedValue()) : ResourcePack::KernelAny;
+	e.maxKernel = file["MaxKernel"] ? static_cast<uint32_t>(file["MaxKernel"].unsignedValue()) : ResourcePack::KernelAny;
+	e.uncompressedSize = static_cast<uint32_t>(raw.size());
+
+	if (packExternal) {
+		auto x = e;
+		x.compressedSize = static_cast<uint32_t>(data.size());
+		x.checksum = ResourcePack::checksum(data.data(), data.size());
+		auto same = shard.externalMap.find(data);
+		if (same != shard.externalMap.end()) {
+			x.offset = same->second;
+		} else {
+			x.offset = static_cast<uint32_t>(shard.externalData.size());
+			shard.externalData.insert(shard.externalData.end(), data.begin(), data.end());
+			shard.externalMap.emplace(data, x.offset);
+		}
+		shard.externalEntries.push_back(x);
+	}
+
+	// Dictionary streams replace plain ones only when they are smaller
+	if (!packDictionary.empty()) {
+		std::vector<uint8_t> check;
+		auto dictData = deflateWithDictionary(raw);
+		if (dictData.empty() || !inflateWithDictionary(dictData, check, raw.size()) || check != raw)
+			ERROR("Dictionary round trip failed for %s", fullInPath.c_str());
+		if (dictData.size() < data.size()) {
+			e.encoding = ResourcePack::EncodingZlibDict;
+			data = std::move(dictData);
+		}
+	}
+
+	// Deltas replace standalone streams only when they are smaller
+	if (job.base) {
+		auto script = makeDelta(*job.base, raw);
+		auto packed = Deflate::compressZlib(script.data(), script.size(), Z_DEFAULT_STRATEGY, 9);
+		std::vector<uint8_t> delta;
+		writeVarint(delta, job.baseNum);
+		writeVarint(delta, script.size());
+		delta.insert(delta.end(), packed.begin(), packed.end());
+
+		std::vector<uint8_t> check(raw.size());
+		if (packed.empty() || ResourcePack::applyDelta(script.data(), script.size(), job.base->data(), job.base->size(),
+													   check.data(), check.size()) != raw.size() || check != raw)
+			ERROR("Delta round trip failed for %s", fullInPath.c_str());
+		if (delta.size() < data.size()) {
+			e.encoding = ResourcePack::EncodingDelta;
+			data = std::move(delta);
+		}
+	}
+
+	e.compressedSize = static_cast<uint32_t>(data.size());
+	e.checksum = ResourcePack::checksum(data.data(), data.size());
+	e.offset = storePackData(shard, std::move(data));
+	shard.entries.push_back(e);
+
+	if (packLZ4) {
+		auto lz4 = LZ4::compress(raw.data(), raw.size());
+		e.encoding = ResourcePack::EncodingLZ4;
+		e.compressedSize = static_cast<uint32_t>(lz4.size());
+		e.checksum = ResourcePack::checksum(lz4.data(), lz4.size());
+		e.offset = storePackData(shard, std::move(lz4));
+		shard.entries.push_back(e);
+	}
+
+	// Only AppleHDA up to 10.6 has its dictionaries unserialized by AppleALC
+	bool binaryKernel = e.minKernel == ResourcePack::KernelAny || e.minKernel <= ResourcePack::KernelSnowLeopard;
+	if (packBinary && binaryKernel) {
+		Value root;
+		if (!Plist::parse(reinterpret_cast<const char *>(raw.data()), raw.size(), root) || !root.isDict())
+			ERROR("Invalid dictionary in %s", fullInPath.c_str());
+
+		std::vector<uint8_t> bin;
+		try {
+			serializeBinary(root, bin, 0, true);
+		} catch (const std::exception &err) {
+			ERROR("Failed to serialize %s: %s", fullInPath.c_str(), err.what());
+		}
+
+		std::vector<uint8_t> check;
+		auto packed = Deflate::compressZlib(bin.data(), bin.size(), Z_DEFAULT_STRATEGY, 9);
+		if (packed.empty() || !inflateData(packed, check) || check != bin)
+			ERROR("Binary round trip failed for %s", fullInPath.c_str());
+
+		e.encoding = ResourcePack::EncodingBinary;
+		if (e.maxKernel == ResourcePack::KernelAny || e.maxKernel > ResourcePack::KernelSnowLeopard)
+			e.maxKernel = ResourcePack::KernelSnowLeopard;
+		e.compressedSize = static_cast<uint32_t>(packed.size());
+		e.uncompressedSize = static_cast<uint32_t>(bin.size());
+		e.checksum = ResourcePack::checksum(packed.data(), packed.size());
+		e.offset = storePackData(shard, std::move(packed));
+		shard.entries.push_back(e);
 	}
-	
-	[ctrlModSection appendString:@"};\n"];
-	[ctrlModSection appendFormat:@"\nconst size_t ADDPR(controllerModSize) {%lu};\n", [ctrls count]];
-	appendFile(file, ctrlModSection);
 }
 
-static void generateVendors(NSString *file, NSDictionary *vendors, NSString *path, NSDictionary *kextIndexes) {
-	auto vendorSection = [[NSMutableString alloc] initWithUTF8String:"\n// Vendor section\n\n"];
+/**
+ *  Emit a CodecModInfo::File table sorted by layout id, see selectCodecFile
+ *  Entries sharing a layout id keep their plist order, so the first compatible one still wins.
+ */
+static std::string generateFileTable(const Value &files, const std::string &path,
+									 uint16_t vendor, uint16_t codec, ResourcePack::Kind kind) {
+	std::vector<const Value *> sorted;
+	for (auto &f : files.array)
+		sorted.push_back(&f);
+	std::stable_sort(sorted.begin(), sorted.end(), [](const Value *a, const Value *b) {
+		return (*a)["Id"].unsignedValue() < (*b)["Id"].unsignedValue();
+	});
 
-	appendFile(file, @"#ifdef HAVE_ANALOG_AUDIO\n");
+	if (packMode) {
+		auto &shard = packShards[currentShard];
+		if (!shard.upToDate) {
+			for (auto p : sorted)
+				shard.jobs.push_back({path, p, vendor, codec, kind, nullptr, 0});
+		}
+		return "{ 0 }, 0";
+	}
 
-	[vendorSection appendString:@"VendorModInfo ADDPR(vendorMod)[] {\n"];
-	
-	for (NSString *dictKey in vendors) {
-		NSNumber *vendorID = [vendors objectForKey:dictKey];
-		size_t num = generateCodecs(file, dictKey, path, kextIndexes);
-		[vendorSection appendFormat:@"\t{ DEBUG_STRING(\"%@\"), 0x%X, codecMod%@, %zu },\n",
-			dictKey, [vendorID unsignedShortValue], dictKey, num];
+	std::string pStr;
+	for (auto p : sorted) {
+		pStr += format("\t{ %s, %s, %s, %s },\n",
+			generateFile(path, (*p)["Path"].string).c_str(),
+			numberOr((*p)["MinKernel"], "KernelPatcher::KernelAny").c_str(),
+			numberOr((*p)["MaxKernel"], "KernelPatcher::KernelAny").c_str(),
+			numberOr((*p)["Id"], "0").c_str()
+		);
 	}
-	
-	[vendorSection appendString:@"};\n"];
-	[vendorSection appendFormat:@"\nconst size_t ADDPR(vendorModSize) {%lu};\n", [vendors count]];
-	appendFile(file, vendorSection);
-	appendFile(file, @"#endif\n");
+
+	return format("{ %zu }, %zu", fileTableArena.add(pStr, sorted.size()), sorted.size());
 }
 
-int main(int argc, const char * argv[]) {
-	if (argc != 3)
-		ERROR("Invalid usage");
+static std::string generatePlatforms(const Value &codecDict, const std::string &path, uint16_t vendor, uint16_t codec) {
+	auto &plats = codecDict["Files"]["Platforms"];
+	if (plats)
+		return generateFileTable(plats, path, vendor, codec, ResourcePack::KindPlatform);
+
+	return "{ 0 }, 0";
+}
 
-	auto basePath = [[NSString alloc] initWithUTF8String:argv[1]];
-	auto vendorsCfg = [[NSString alloc] initWithFormat:@"%@/Vendors.plist", basePath];
-	auto kextsCfg = [[NSString alloc] initWithFormat:@"%@/Kexts.plist",basePath];
-	auto ctrlsCfg = [[NSString alloc] initWithFormat:@"%@/Controllers.plist",basePath];
-	//auto userCfg = [[NSString alloc] initWithFormat:@"%@/UserPatches.plist",basePath];
-	auto outputCpp = [[NSString alloc] initWithUTF8String:argv[2]];
+static std::string generateLayouts(const Value &codecDict, const std::string &path, uint16_t vendor, uint16_t codec) {
+	auto &lts = codecDict["Files"]["Layouts"];
+	if (lts)
+		return generateFileTable(lts, path, vendor, codec, ResourcePack::KindLayout);
 
-	auto vendors = [NSDictionary dictionaryWithContentsOfFile:vendorsCfg];
-	auto kexts = [NSDictionary dictionaryWithContentsOfFile:kextsCfg];
-	auto ctrls = [NSArray arrayWithContentsOfFile:ctrlsCfg];
-	//auto userp = [NSArray arrayWithContentsOfFile:userCfg];
+	return "{ 0 }, 0";
+}
 
-	if (!vendors || !kexts || !ctrls)
-		ERROR("Missing resource data (vendors:%p, kexts:%p, ctrls:%p)", vendors, kexts, ctrls);
+/**
+ *  Serialize pack entries and data into ResourcePack format
+ */
+static std::vector<uint8_t> buildPack(std::vector<ResourcePack::Entry> entries, const std::vector<uint8_t> &data) {
+	std::stable_sort(entries.begin(), entries.end(), [](const ResourcePack::Entry &a, const ResourcePack::Entry &b) {
+		if (a.vendor != b.vendor) return a.vendor < b.vendor;
+		if (a.codec != b.codec) return a.codec < b.codec;
+		if (a.kind != b.kind) return a.kind < b.kind;
+		return a.layout < b.layout;
+	});
 
-	// Create a file
-	[[NSFileManager defaultManager] createFileAtPath:outputCpp contents:nil attributes:nil];
+	ResourcePack::Header hdr {};
+	hdr.magic = ResourcePack::Magic;
+	hdr.version = ResourcePack::Version;
+	hdr.entryNum = static_cast<uint32_t>(entries.size());
+	hdr.entryOffset = sizeof(hdr);
+	hdr.dataOffset = static_cast<uint32_t>(sizeof(hdr) + entries.size() * sizeof(ResourcePack::Entry));
+	hdr.dataSize = static_cast<uint32_t>(data.size());
 
-	try {
-		appendFile(outputCpp, ResourceHeader);
-		auto kextIndexes = generateKexts(outputCpp, kexts);
-		generateVendors(outputCpp, vendors, basePath, kextIndexes);
-		generateControllers(outputCpp, ctrls, vendors, kextIndexes);
-	} catch (...) {
-		ERROR("Fatal error during generation");
+	std::vector<uint8_t> pack;
+	auto ptr = reinterpret_cast<const uint8_t *>(&hdr);
+	pack.insert(pack.end(), ptr, ptr + sizeof(hdr));
+	ptr = reinterpret_cast<const uint8_t *>(entries.data());
+	pack.insert(pack.end(), ptr, ptr + entries.size() * sizeof(ResourcePack::Entry));
+	pack.insert(pack.end(), data.begin(), data.end());
+	return pack;
+}
+
+/**
+ *  Shard source path derived from the main output, kern_resources.cpp -> kern_resources_shardN.cpp
+ */
+static std::string shardPath(const std::string &outputCpp, size_t shard) {
+	auto base = outputCpp;
+	auto dot = base.rfind(".cpp");
+	if (dot != std::string::npos && dot + 4 == base.size())
+		base.erase(dot);
+	return format("%s_shard%zu.cpp", base.c_str(), shard);
+}
+
+static std::string manifestPath(const std::string &outputCpp) {
+	auto base = outputCpp;
+	auto dot = base.rfind(".cpp");
+	if (dot != std::string::npos && dot + 4 == base.size())
+		base.erase(dot);
+	return base + ".manifest";
+}
+
+static std::string reportPath(const std::string &outputCpp) {
+	auto base = outputCpp;
+	auto dot = base.rfind(".cpp");
+	if (dot != std::string::npos && dot + 4 == base.size())
+		base.erase(dot);
+	return base + ".report.json";
+}
+
+static size_t shardFor(const std::string &codecDir) {
+	return hashBytes(reinterpret_cast<const uint8_t *>(codecDir.data()), codecDir.size()) % ShardCount;
+}
+
+/**
+ *  Parsed codec directory with hashes of its inputs
+ */
+struct CodecDir {
+	std::string name;
+	std::string path;
+	Value dict;
+	std::string inputs;
+};
+
+/**
+ *  Parse every codec Info.plist and hash the referenced files once, in parallel
+ *
+ *  @param basePath Resources directory
+ *
+ *  @return codec directories in sorted name order
+ */
+static std::vector<CodecDir> loadCodecDirs(const std::string &basePath) {
+	auto entries = listDirectory(basePath);
+	std::vector<CodecDir> dirs(entries.size());
+
+	parallelFor(entries.size(), [&](size_t i) {
+		auto baseDirStr = basePath + "/" + entries[i];
+		auto infoCfgStr = baseDirStr + "/Info.plist";
+		std::vector<uint8_t> data;
+		if (!fileExists(infoCfgStr) || !Plist::readFile(infoCfgStr, data))
+			return;
+
+		auto &dir = dirs[i];
+		dir.name = entries[i];
+		dir.path = baseDirStr;
+		dir.inputs = format("%s:%016llx;", entries[i].c_str(), static_cast<unsigned long long>(hashBytes(data.data(), data.size())));
+		Plist::parse(reinterpret_cast<const char *>(data.data()), data.size(), dir.dict);
+
+		for (auto kind : {"Layouts", "Platforms"}) {
+			for (auto &file : dir.dict["Files"][kind].array) {
+				data.clear();
+				Plist::readFile(baseDirStr + "/" + file["Path"].string, data);
+				dir.inputs += format("%s:%016llx;", file["Path"].string.c_str(), static_cast<unsigned long long>(hashBytes(data.data(), data.size())));
+			}
+		}
+	});
+
+	dirs.erase(std::remove_if(dirs.begin(), dirs.end(), [](const CodecDir &d) { return d.name.empty(); }), dirs.end());
+	return dirs;
+}
+
+/**
+ *  Train the preset dictionary on runs of up to DictionaryMaxRun elements shared by
+ *  several documents. Packed xmls have no whitespace between tags, so a run is a
+ *  sequence like <key>MuteInputAmp</key><true/>. Each run scores the bytes it saves
+ *  in every document, the best scoring runs go last where back references are the shortest.
+ *
+ *  @param codecDirs parsed codec directories
+ */
+static void trainDictionary(const std::vector<CodecDir> &codecDirs) {
+	std::vector<std::string> paths;
+	for (auto &dir : codecDirs) {
+		for (auto kind : {"Layouts", "Platforms"}) {
+			for (auto &file : dir.dict["Files"][kind].array)
+				paths.push_back(dir.path + "/" + file["Path"].string);
+		}
+	}
+
+	std::vector<std::vector<std::string>> docRuns(paths.size());
+	parallelFor(paths.size(), [&](size_t i) {
+		std::vector<uint8_t> data, raw;
+		if (!Plist::readFile(paths[i], data) || !inflateData(data, raw))
+			ERROR("Failed to read %s", paths[i].c_str());
+
+		// Elements start at every opening tag
+		std::vector<size_t> starts;
+		for (size_t p = 0; p + 1 < raw.size(); p++) {
+			if (raw[p] == '<' && raw[p + 1] != '/')
+				starts.push_back(p);
+		}
+		starts.push_back(raw.size());
+
+		auto &runs = docRuns[i];
+		for (size_t e = 0; e + 1 < starts.size(); e++) {
+			for (size_t n = 1; n <= DictionaryMaxRun && e + n < starts.size(); n++) {
+				auto len = starts[e + n] - starts[e];
+				if (len > DictionaryMaxLine)
+					break;
+				runs.emplace_back(raw.begin() + starts[e], raw.begin() + starts[e + n]);
+			}
+		}
+		std::sort(runs.begin(), runs.end());
+		runs.erase(std::unique(runs.begin(), runs.end()), runs.end());
+	});
+
+	std::map<std::string, size_t> docFreq;
+	for (auto &runs : docRuns) {
+		for (auto &run : runs)
+			docFreq[run]++;
+	}
+
+	std::vector<std::pair<size_t, const std::string *>> scored;
+	for (auto &kv : docFreq) {
+		if (kv.second > 1)
+			scored.emplace_back(kv.second * kv.first.size(), &kv.first);
+	}
+	// Stable across runs, ties are broken by run text through map order
+	std::stable_sort(scored.begin(), scored.end(), [](const std::pair<size_t, const std::string *> &a, const std::pair<size_t, const std::string *> &b) {
+		return a.first > b.first;
+	});
+
+	// Runs already covered by a chosen one add nothing
+	std::string chosen;
+	std::vector<const std::string *> order;
+	for (auto &s : scored) {
+		if (chosen.size() + s.second->size() > DictionaryMaxSize)
+			continue;
+		if (chosen.find(*s.second) != std::string::npos)
+			continue;
+		chosen += *s.second;
+		order.push_back(s.second);
+	}
+
+	packDictionary.clear();
+	for (auto it = order.rbegin(); it != order.rend(); ++it)
+		packDictionary.insert(packDictionary.end(), (*it)->begin(), (*it)->end());
+}
+
+/**
+ *  Load the preset dictionary stored by writeDictionary
+ */
+static void readDictionary(const std::string &path) {
+	std::vector<uint8_t> data;
+	uint32_t hdr[2] {};
+	if (!Plist::readFile(path, data) || data.size() < sizeof(hdr))
+		ERROR("Failed to read %s", path.c_str());
+	memcpy(hdr, data.data(), sizeof(hdr));
+	if (hdr[0] != DictionaryMagic || hdr[1] != DictionaryVersion || data.size() - sizeof(hdr) > DictionaryMaxSize)
+		ERROR("Unsupported dictionary in %s, retrain it with --train-dict", path.c_str());
+	packDictionary.assign(data.begin() + sizeof(hdr), data.end());
+}
+
+static void writeDictionary(const std::string &path) {
+	uint32_t hdr[2] {DictionaryMagic, DictionaryVersion};
+	OutputWriter dict;
+	if (!dict.open(path))
+		ERROR("Failed to create %s", path.c_str());
+	dict.append(std::string(reinterpret_cast<const char *>(hdr), sizeof(hdr)));
+	dict.append(std::string(packDictionary.begin(), packDictionary.end()));
+	if (!dict.close())
+		ERROR("Failed to write %s", path.c_str());
+}
+
+static void collectKeys(const Value &v, std::unordered_map<std::string, size_t> &counts) {
+	for (auto &kv : v.dict) {
+		counts[kv.first]++;
+		collectKeys(kv.second, counts);
+	}
+	for (auto &item : v.array)
+		collectKeys(item, counts);
+}
+
+/**
+ *  Parse every layout and platform of the codecs for building the binary tables
+ *
+ *  @param codecDirs parsed codec directories
+ *  @param paths     resulting document paths
+ *  @param platforms resulting flags telling platforms from layouts
+ *
+ *  @return parsed documents
+ */
+static std::vector<Value> loadBinaryDocs(const std::vector<CodecDir> &codecDirs, std::vector<std::string> &paths, std::vector<bool> &platforms) {
+	for (auto &dir : codecDirs) {
+		for (auto kind : {"Layouts", "Platforms"}) {
+			for (auto &file : dir.dict["Files"][kind].array) {
+				paths.push_back(dir.path + "/" + file["Path"].string);
+				platforms.push_back(!strcmp(kind, "Platforms"));
+			}
+		}
+	}
+
+	std::vector<Value> docs(paths.size());
+	parallelFor(paths.size(), [&](size_t i) {
+		std::vector<uint8_t> data, raw;
+		if (!Plist::readFile(paths[i], data) || !inflateData(data, raw) ||
+			!Plist::parse(reinterpret_cast<const char *>(raw.data()), raw.size(), docs[i]))
+			ERROR("Failed to read %s", paths[i].c_str());
+	});
+	return docs;
+}
+
+static void addSharedSubtree(const std::vector<uint8_t> &subtree) {
+	if (!sharedSubtreeMap.emplace(subtree, static_cast<uint32_t>(sharedSubtreeOffsets.size())).second)
+		ERROR("Duplicate shared subtree");
+	sharedSubtreeOffsets.push_back(static_cast<uint32_t>(sharedSubtrees.size()));
+	sharedSubtrees.insert(sharedSubtrees.end(), subtree.begin(), subtree.end());
+}
+
+/**
+ *  Train the binary tables: the key table on the dictionary keys of every layout and platform,
+ *  and the shared subtrees on PathMaps elements repeated across the platforms of all codecs
+ *
+ *  @param codecDirs parsed codec directories
+ */
+static void trainTables(const std::vector<CodecDir> &codecDirs) {
+	std::vector<std::string> paths;
+	std::vector<bool> platforms;
+	auto docs = loadBinaryDocs(codecDirs, paths, platforms);
+
+	// Frequent keys get the shortest ids, ties are broken by name to keep the table stable
+	std::unordered_map<std::string, size_t> keyCounts;
+	for (auto &doc : docs)
+		collectKeys(doc, keyCounts);
+	std::vector<std::pair<std::string, size_t>> keys(keyCounts.begin(), keyCounts.end());
+	std::sort(keys.begin(), keys.end(), [](const std::pair<std::string, size_t> &a, const std::pair<std::string, size_t> &b) {
+		return a.second != b.second ? a.second > b.second : a.first < b.first;
+	});
+	keyTable.clear();
+	keyIds.clear();
+	for (auto &k : keys) {
+		if (k.first.find('\0') != std::string::npos)
+			ERROR("Dictionary key with zero byte");
+		keyIds.emplace(k.first, static_cast<uint32_t>(keyTable.size()));
+		keyTable.push_back(k.first);
+	}
+
+	// Subtrees are serialized against the key table they are stored with
+	std::vector<std::vector<std::vector<uint8_t>>> docMaps(paths.size());
+	parallelFor(paths.size(), [&](size_t i) {
+		if (!platforms[i])
+			return;
+		for (auto &pathMap : docs[i]["PathMaps"].array) {
+			docMaps[i].emplace_back();
+			try {
+				serializeBinary(pathMap, docMaps[i].back(), 2);
+			} catch (const std::exception &err) {
+				ERROR("Failed to serialize %s: %s", paths[i].c_str(), err.what());
+			}
+		}
+	});
+
+	std::unordered_map<std::vector<uint8_t>, size_t> counts;
+	std::vector<const std::vector<uint8_t> *> order;
+	for (auto &maps : docMaps) {
+		for (auto &m : maps) {
+			if (counts[m]++ == 0)
+				order.push_back(&m);
+		}
+	}
+
+	for (auto m : order) {
+		if (counts[*m] >= 2)
+			addSharedSubtree(*m);
+	}
+}
+
+/**
+ *  Load the binary tables stored by writeTables
+ */
+static void readTables(const std::string &path) {
+	std::vector<uint8_t> data;
+	uint32_t hdr[4] {};
+	if (!Plist::readFile(path, data) || data.size() < sizeof(hdr))
+		ERROR("Failed to read %s", path.c_str());
+	memcpy(hdr, data.data(), sizeof(hdr));
+	if (hdr[0] != TablesMagic || hdr[1] != TablesVersion)
+		ERROR("Unsupported binary tables in %s, retrain them with --train-tables", path.c_str());
+
+	const uint8_t *ptr = data.data() + sizeof(hdr);
+	const uint8_t *end = data.data() + data.size();
+	for (uint32_t i = 0; i < hdr[2]; i++) {
+		auto term = static_cast<const uint8_t *>(memchr(ptr, '\0', end - ptr));
+		if (!term)
+			ERROR("Malformed key table in %s", path.c_str());
+		std::string key(reinterpret_cast<const char *>(ptr), term - ptr);
+		if (!keyIds.emplace(key, static_cast<uint32_t>(keyTable.size())).second)
+			ERROR("Malformed key table in %s", path.c_str());
+		keyTable.push_back(key);
+		ptr = term + 1;
+	}
+
+	for (uint32_t i = 0; i < hdr[3]; i++) {
+		uint64_t len;
+		if (!ResourcePack::readVarint(ptr, end, len) || len == 0 || len > static_cast<uint64_t>(end - ptr))
+			ERROR("Malformed shared subtrees in %s", path.c_str());
+		addSharedSubtree(std::vector<uint8_t>(ptr, ptr + len));
+		ptr += len;
+	}
+
+	if (ptr != end)
+		ERROR("Malformed binary tables in %s", path.c_str());
+}
+
+static void writeTables(const std::string &path) {
+	uint32_t hdr[4] {TablesMagic, TablesVersion, static_cast<uint32_t>(keyTable.size()), static_cast<uint32_t>(sharedSubtreeOffsets.size())};
+	OutputWriter tables;
+	if (!tables.open(path))
+		ERROR("Failed to create %s", path.c_str());
+	tables.append(std::string(reinterpret_cast<const char *>(hdr), sizeof(hdr)));
+	for (auto &k : keyTable)
+		tables.append(std::string(k.c_str(), k.size() + 1));
+	for (size_t i = 0; i < sharedSubtreeOffsets.size(); i++) {
+		size_t end = i + 1 < sharedSubtreeOffsets.size() ? sharedSubtreeOffsets[i + 1] : sharedSubtrees.size();
+		std::vector<uint8_t> subtree;
+		writeVarint(subtree, end - sharedSubtreeOffsets[i]);
+		subtree.insert(subtree.end(), sharedSubtrees.begin() + sharedSubtreeOffsets[i], sharedSubtrees.begin() + end);
+		tables.append(std::string(subtree.begin(), subtree.end()));
+	}
+	if (!tables.close())
+		ERROR("Failed to write %s", path.c_str());
+}
+
+/**
+ *  Hash every input of each shard: codec Info.plist files, referenced layouts and platforms, and generator options
+ */
+static void hashShardInputs(const std::vector<CodecDir> &codecDirs, const std::string &options) {
+	std::string inputs[ShardCount];
+	for (auto &dir : codecDirs)
+		inputs[shardFor(dir.name)] += dir.inputs;
+
+	for (size_t i = 0; i < ShardCount; i++) {
+		inputs[i] += options;
+		packShards[i].inputHash = hashBytes(reinterpret_cast<const uint8_t *>(inputs[i].data()), inputs[i].size());
+	}
+}
+
+/**
+ *  Mark shards whose inputs match the manifest and whose sources exist as up to date
+ */
+static void readManifest(const std::string &outputCpp) {
+	auto f = fopen(manifestPath(outputCpp).c_str(), "r");
+	if (!f)
+		return;
+
+	size_t shard;
+	unsigned long long hash;
+	while (fscanf(f, "shard %zu %llx\n", &shard, &hash) == 2) {
+		if (shard < ShardCount && packShards[shard].inputHash == hash && fileExists(shardPath(outputCpp, shard)))
+			packShards[shard].upToDate = true;
+	}
+
+	fclose(f);
+}
+
+static void writeManifest(const std::string &outputCpp) {
+	OutputWriter manifest;
+	manifest.openDeferred(manifestPath(outputCpp));
+	for (size_t i = 0; i < ShardCount; i++)
+		manifest.appendf("shard %zu %016llx\n", i, static_cast<unsigned long long>(packShards[i].inputHash));
+	if (!manifest.close())
+		ERROR("Failed to write %s", manifestPath(outputCpp).c_str());
+}
+
+/**
+ *  Emit shard sources with their resource packs and the ADDPR(resourcePacks) index
+ *
+ *  @param outputCpp main output path
+ *  @param packFile  optional path to store all shards as one raw pack
+ *
+ *  @return number of rewritten shards
+ */
+static size_t generateResourcePacks(const std::string &outputCpp, const std::string &packFile) {
+	std::atomic<size_t> written {0};
+
+	// Shards share no state, each one is compressed, serialized and written by a single worker
+	parallelFor(ShardCount, [&](size_t i) {
+		auto &shard = packShards[i];
+		if (shard.upToDate)
+			return;
+
+		if (packDelta)
+			planDeltas(shard);
+		for (auto &job : shard.jobs)
+			addPackEntry(shard, job);
+		if (packDelta)
+			addDeltaBases(shard);
+
+		OutputWriter shardOut;
+		shardOut.openDeferred(shardPath(outputCpp, i));
+		shardOut.append(ResourceHeader);
+		shardOut.append("#ifdef HAVE_ANALOG_AUDIO\n");
+		if (packMode) {
+			auto pack = buildPack(shard.entries, shard.data);
+			// Namespace scope const objects have internal linkage unless declared extern
+			shardOut.appendf("extern const uint8_t ADDPR(resourcePack%zu)[];\nextern const size_t ADDPR(resourcePack%zuSize);\n", i, i);
+			appendBlob(shardOut, "alignas(ResourcePack::Entry) const uint8_t", format("ADDPR(resourcePack%zu)", i), pack.data(), pack.size());
+			shardOut.appendf("const size_t ADDPR(resourcePack%zuSize) {%zu};\n", i, pack.size());
+		}
+		shardOut.append("#endif\n");
+
+		if (!shardOut.close())
+			ERROR("Failed to write %s", shardPath(outputCpp, i).c_str());
+		if (shardOut.wasChanged())
+			written++;
+	});
+
+	for (auto &shard : packShards) {
+		dedupFileNum += shard.dedupNum;
+		dedupFileBytes += shard.dedupBytes;
+	}
+
+	if (packMode && !packFile.empty()) {
+		// Raw pack keeps every shard in a single index and is read piece by piece, see ResourcePack::indexSize
+		std::vector<ResourcePack::Entry> entries;
+		std::vector<uint8_t> data;
+		for (auto &shard : packShards) {
+			for (auto e : shard.externalEntries) {
+				e.offset += static_cast<uint32_t>(data.size());
+				entries.push_back(e);
+			}
+			data.insert(data.end(), shard.externalData.begin(), shard.externalData.end());
+		}
+
+		auto pack = buildPack(entries, data);
+		OutputWriter bin;
+		if (!bin.open(packFile))
+			ERROR("Failed to create %s", packFile.c_str());
+		bin.append(std::string(pack.begin(), pack.end()));
+		if (!bin.close())
+			ERROR("Failed to write %s", packFile.c_str());
+	}
+
+	out.append("\n// Resource pack section\n\n#ifdef HAVE_ANALOG_AUDIO\n");
+	if (packMode) {
+		for (size_t i = 0; i < ShardCount; i++)
+			out.appendf("extern const uint8_t ADDPR(resourcePack%zu)[];\nextern const size_t ADDPR(resourcePack%zuSize);\n", i, i);
+		out.append("\nconst ResourcePackInfo ADDPR(resourcePacks)[] {\n");
+		for (size_t i = 0; i < ShardCount; i++)
+			out.appendf("\t{ ADDPR(resourcePack%zu), &ADDPR(resourcePack%zuSize) },\n", i, i);
+		out.append("};\n");
+		out.appendf("const size_t ADDPR(resourcePackNum) {%zu};\n", ShardCount);
+	} else {
+		out.append("const ResourcePackInfo ADDPR(resourcePacks)[1] {};\n");
+		out.append("const size_t ADDPR(resourcePackNum) {0};\n");
+	}
+	if (!packDictionary.empty()) {
+		out.append("\n");
+		appendBlob(out, "const uint8_t", "ADDPR(resourceDictionary)", packDictionary.data(), packDictionary.size());
+	} else {
+		out.append("const uint8_t ADDPR(resourceDictionary)[1] {};\n");
+	}
+	out.appendf("const size_t ADDPR(resourceDictionarySize) {%zu};\n", packDictionary.size());
+	if (!sharedSubtreeOffsets.empty()) {
+		out.append("\n");
+		appendBlob(out, "const uint8_t", "ADDPR(resourceSubtrees)", sharedSubtrees.data(), sharedSubtrees.size());
+		out.append("const uint32_t ADDPR(resourceSubtreeOffsets)[] {\n\t");
+		for (auto off : sharedSubtreeOffsets)
+			out.appendf("%u, ", off);
+		out.append("\n};\n");
+	} else {
+		out.append("const uint8_t ADDPR(resourceSubtrees)[1] {};\n");
+		out.append("const uint32_t ADDPR(resourceSubtreeOffsets)[1] {};\n");
+	}
+	out.appendf("const size_t ADDPR(resourceSubtreesSize) {%zu};\n", sharedSubtrees.size());
+	out.appendf("const size_t ADDPR(resourceSubtreeNum) {%zu};\n", sharedSubtreeOffsets.size());
+	if (!keyTable.empty()) {
+		std::vector<uint8_t> keys;
+		out.append("\nconst uint32_t ADDPR(resourceKeyOffsets)[] {\n\t");
+		for (auto &k : keyTable) {
+			out.appendf("%zu, ", keys.size());
+			keys.insert(keys.end(), k.begin(), k.end());
+			keys.push_back('\0');
+		}
+		out.append("\n};\n");
+		out.append("const uint8_t ADDPR(resourceKeys)[] {\n");
+		out.appendBytes(keys.data(), keys.size());
+		out.append("};\n");
+	} else {
+		out.append("const uint32_t ADDPR(resourceKeyOffsets)[1] {};\n");
+		out.append("const uint8_t ADDPR(resourceKeys)[1] {};\n");
+	}
+	out.appendf("const size_t ADDPR(resourceKeyNum) {%zu};\n", keyTable.size());
+	out.append("#endif\n");
+
+	return written.load();
+}
+
+/**
+ *  All patch find and replace bytes share a single arena, patchBufMap maps
+ *  byte runs to their arena offsets and patchSuffixMap every suffix of the
+ *  stored runs, so that each run costs a single lookup.
+ */
+static std::vector<uint8_t> patchArena;
+static std::unordered_map<std::vector<uint8_t>, size_t> patchBufMap;
+static std::unordered_map<std::vector<uint8_t>, size_t> patchSuffixMap;
+static size_t patchBufBytes {0};
+
+static size_t storePatchBuf(const uint8_t *patch, size_t len) {
+	std::vector<uint8_t> k;
+	k.assign(patch, patch+len);
+	auto it = patchBufMap.find(k);
+	if (it != patchBufMap.end())
+		return it->second;
+
+	patchBufBytes += len;
+
+	// Reuse a stored run or one of its suffixes
+	size_t off {0};
+	auto found = patchSuffixMap.find(k);
+	if (found != patchSuffixMap.end()) {
+		off = found->second;
+	} else if (len > 0) {
+		// Otherwise overlap the arena tail with the run prefix as much as possible
+		size_t overlap = std::min(len - 1, patchArena.size());
+		while (overlap > 0 && memcmp(&patchArena[patchArena.size() - overlap], patch, overlap) != 0)
+			overlap--;
+		off = patchArena.size() - overlap;
+		patchArena.insert(patchArena.end(), patch + overlap, patch + len);
+		for (size_t i = 0; i < len; i++)
+			patchSuffixMap.emplace(std::vector<uint8_t>(patch + i, patch + len), off + i);
+	}
+
+	patchBufMap.emplace(std::move(k), off);
+	return off;
+}
+
+static void generatePatchArena() {
+	out.append("\n// Patch arena section\n\n");
+	out.append("const uint8_t ADDPR(patchArena)[] {\n");
+	out.appendBytes(patchArena.data(), patchArena.size());
+	out.append("};\n");
+	out.appendf("\nconst size_t ADDPR(patchArenaSize) {%zu};\n", patchArena.size());
+}
+
+static void generateTableArena(const char *decl, const TableArena &arena) {
+	out.appendf("%s[] {\n", decl);
+	// Keep the array non-empty, no reference points into an empty arena
+	out.append(arena.size > 0 ? arena.body : "\t{},\n");
+	out.append("};\n");
+}
+
+/**
+ *  Emit the arrays generated tables refer to by index, see TableArena
+ */
+static void generateArenas() {
+	out.append("\n// Table arena section\n\n");
+	out.append("const char ADDPR(stringArena)[] {\n#ifdef DEBUG\n");
+	out.append(stringArena.body);
+	out.append("#endif\n\t\"\"\n};\n");
+	generateTableArena("const uint32_t ADDPR(revisionArena)", revisionArena);
+	generateTableArena("const KextPatch ADDPR(kextPatches)", kextPatchArena);
+
+	out.append("\n#ifdef HAVE_ANALOG_AUDIO\n");
+	generateTableArena("const CodecFile ADDPR(fileTable)", fileTableArena);
+	if (!fileArena.empty())
+		appendBlob(out, "const uint8_t", "ADDPR(fileArena)", fileArena.data(), fileArena.size());
+	else
+		out.append("const uint8_t ADDPR(fileArena)[1] {};\n");
+	out.append("#endif\n");
+}
+
+/**
+ *  Kernel range of every emitted patch per patch list, see generatePatchBuckets
+ */
+static std::vector<std::vector<std::pair<uint32_t, uint32_t>>> patchListKernels;
+
+/**
+ *  First kernel major version with its own patch bucket (Tiger)
+ */
+static constexpr uint32_t PatchBucketMin {8};
+
+static std::string generatePatches(const Value &patches, const std::map<std::string, size_t> &kextIndexes) {
+	// Every list gets a bucket slot, even an empty one, so that list ids are dense
+	size_t patchList = patchListKernels.size();
+	patchListKernels.emplace_back();
+
+	if (patches) {
+		std::string pStr;
+		for (auto &p : patches.array) {
+			const size_t PatchNum = 2;
+			const std::vector<uint8_t> *f[PatchNum] = {&p["Find"].data, &p["Replace"].data};
+			size_t patchBufOffsets[PatchNum] {};
+
+			if (f[0]->size() != f[1]->size()) {
+				pStr += "#error not matching patch lengths\n";
+				continue;
+			}
+
+			for (size_t i = 0; i < PatchNum; i++)
+				patchBufOffsets[i] = storePatchBuf(f[i]->data(), f[i]->size());
+
+			auto kext = kextIndexes.find(p["Name"].string);
+			if (kext == kextIndexes.end())
+				ERROR("Unknown kext %s in patch", p["Name"].string.c_str());
+
+			pStr += format("\t{ { %zu }, { %zu }, { %zu }, %zu, %s, %s, %s },\n",
+				kext->second,
+				patchBufOffsets[0],
+				patchBufOffsets[1],
+				f[0]->size(),
+				numberOr(p["Count"], "0").c_str(),
+				numberOr(p["MinKernel"], "KernelPatcher::KernelAny").c_str(),
+				numberOr(p["MaxKernel"], "KernelPatcher::KernelAny").c_str()
+			);
+			patchListKernels[patchList].emplace_back(
+				p["MinKernel"] ? static_cast<uint32_t>(p["MinKernel"].integer) : 0,
+				p["MaxKernel"] ? static_cast<uint32_t>(p["MaxKernel"].integer) : 0);
+		}
+
+		auto start = kextPatchArena.add(pStr, patches.count());
+		return format("{ %zu }, %zu, %zu", start, patches.count(), patchList);
+	}
+
+	return format("{ 0 }, 0, %zu", patchList);
+}
+
+/**
+ *  Emit per kernel major version patch buckets.
+ *  Bucket b holds the patches valid for kernel PatchBucketMin + b, the last bucket follows
+ *  the highest explicit kernel bound and thus also covers every newer kernel.
+ */
+static void generatePatchBuckets() {
+	uint32_t maxKernel {PatchBucketMin - 1};
+	for (auto &list : patchListKernels) {
+		for (auto &k : list)
+			maxKernel = std::max({maxKernel, k.first, k.second});
+	}
+
+	size_t bucketNum = maxKernel + 2 - PatchBucketMin;
+	std::string startSection {"const uint32_t ADDPR(patchBucketStart)[] {\n"};
+	std::string indexSection {"const uint16_t ADDPR(patchBucketIndex)[] {\n"};
+	size_t indexNum {0};
+
+	for (size_t b = 0; b < bucketNum; b++) {
+		uint32_t kernel = PatchBucketMin + static_cast<uint32_t>(b);
+		startSection += "\t";
+		indexSection += "\t";
+		for (auto &list : patchListKernels) {
+			startSection += format("%zu, ", indexNum);
+			for (size_t p = 0; p < list.size(); p++) {
+				auto &k = list[p];
+				if ((k.first == 0 || k.first <= kernel) && (k.second == 0 || k.second >= kernel)) {
+					indexSection += format("%zu, ", p);
+					indexNum++;
+				}
+			}
+		}
+		startSection += "\n";
+		indexSection += "\n";
+	}
+
+	startSection += format("\t%zu\n};\n", indexNum);
+	// Keep the array non-empty when no patch is valid anywhere
+	indexSection += indexNum > 0 ? "};\n" : "\t0\n};\n";
+
+	out.append("\n// Patch bucket section\n\n");
+	out.appendf("const uint32_t ADDPR(patchBucketMin) {%u};\n", PatchBucketMin);
+	out.appendf("const size_t ADDPR(patchBucketNum) {%zu};\n", bucketNum);
+	out.appendf("const size_t ADDPR(patchListNum) {%zu};\n\n", patchListKernels.size());
+	out.append(startSection);
+	out.append(indexSection);
+}
+
+/**
+ *  Codec lookup table entry: vendor << 16 | codec, vendor index, ADDPR(codecMod) index
+ */
+struct CodecLookupEntry {
+	uint32_t id;
+	size_t vendor;
+	size_t codec;
+};
+
+static std::vector<CodecLookupEntry> codecLookup;
+
+/**
+ *  ADDPR(codecMod) rows of every vendor, each vendor owns a contiguous range
+ */
+static std::string codecModSection;
+static size_t codecModNum {0};
+
+static size_t generateCodecs(const std::string &vendor, size_t vendorIndex, uint16_t vendorID, const std::vector<CodecDir> &codecDirs, const std::map<std::string, size_t> &kextIndexes) {
+	std::string codecSection;
+	size_t codecs {0};
+	for (auto &dir : codecDirs) {
+		auto &codecDict = dir.dict;
+		// Vendor match
+		if (codecDict["Vendor"].string == vendor) {
+			currentShard = shardFor(dir.name);
+			auto revs = generateRevisions(codecDict);
+			auto codecID = static_cast<uint16_t>(codecDict["CodecID"].unsignedValue());
+			auto platforms = generatePlatforms(codecDict, dir.path, vendorID, codecID);
+			auto layouts = generateLayouts(codecDict, dir.path, vendorID, codecID);
+			auto patches = generatePatches(codecDict["Patches"], kextIndexes);
+
+			codecSection += format("\t{ %s, 0x%X, %s, %s, %s, %s },\n",
+				generateName(codecDict["CodecName"].string).c_str(),
+				codecID,
+				revs.c_str(), platforms.c_str(), layouts.c_str(), patches.c_str()
+			);
+			codecLookup.push_back({static_cast<uint32_t>(vendorID) << 16 | codecID,
+				vendorIndex, codecModNum});
+			codecModNum++;
+			codecs++;
+		}
+	}
+
+	if (codecs > 0)
+		codecModSection += format("\t// %s\n", vendor.c_str()) + codecSection;
+
+	return codecs;
+}
+
+/**
+ *  Controller candidate with precomputed checks, see ControllerCandidate
+ */
+struct ControllerCandidateEntry {
+	size_t mod;
+	uint32_t checks;
+};
+
+static constexpr uint32_t ControllerCheckRevision {1};
+static constexpr uint32_t ControllerCheckPlatform {2};
+
+static void generateControllers(const Value &ctrls, const Value &vendors, const std::map<std::string, size_t> &kextIndexes) {
+	out.append("\n// ControllerMod section\n\n");
+
+	std::string ctrlModSection {"const ControllerModInfo ADDPR(controllerMod)[] {\n"};
+	std::map<uint32_t, std::vector<ControllerCandidateEntry>> ctrlLookup;
+
+	for (size_t i = 0; i < ctrls.array.size(); i++) {
+		auto &entry = ctrls.array[i];
+		auto revs = generateRevisions(entry);
+		auto patches = generatePatches(entry["Patches"], kextIndexes);
+
+		const char *model = "WIOKit::ComputerModel::ComputerAny";
+		if (entry["Model"]) {
+			if (entry["Model"].string == "Laptop") {
+				model = "WIOKit::ComputerModel::ComputerLaptop";
+			} else if (entry["Model"].string == "Desktop") {
+				model = "WIOKit::ComputerModel::ComputerDesktop";
+			}
+		}
+
+		auto vendor = static_cast<uint16_t>(vendors[entry["Vendor"].string].unsignedValue());
+		auto device = static_cast<uint16_t>(entry["Device"].unsignedValue());
+
+		ctrlModSection += format("\t{ %s, 0x%X, 0x%X, %s, %s, %s, %s },\n",
+			generateName(entry["Name"].string).c_str(), vendor, device,
+			revs.c_str(), numberOr(entry["Platform"], "ControllerModInfo::PlatformAny").c_str(),
+			model, patches.c_str()
+		);
+
+		uint32_t checks {0};
+		if (entry["Revisions"].count() > 0)
+			checks |= ControllerCheckRevision;
+		if (entry["Platform"] && entry["Platform"].integer != 0)
+			checks |= ControllerCheckPlatform;
+		ctrlLookup[static_cast<uint32_t>(vendor) << 16 | device].push_back({i, checks});
+	}
+
+	ctrlModSection += "};\n";
+	ctrlModSection += format("\nconst size_t ADDPR(controllerModSize) {%zu};\n", ctrls.count());
+	out.append(ctrlModSection);
+
+	// Candidates are grouped by vendor and device keeping Controllers.plist priority
+	std::string candSection {"\n// Controller lookup section\n\n"};
+	std::string lookupSection;
+	candSection += "const ControllerCandidate ADDPR(controllerCandidates)[] {\n";
+	lookupSection += "const ControllerLookupInfo ADDPR(controllerLookup)[] {\n";
+	size_t candIndex {0};
+	for (auto &bucket : ctrlLookup) {
+		lookupSection += format("\t{ 0x%08X, %zu, %zu },\n", bucket.first, candIndex, bucket.second.size());
+		for (auto &cand : bucket.second) {
+			if (cand.mod > UINT16_MAX)
+				ERROR("Too many controller mods");
+			candSection += format("\t{ %zu, 0x%X },\n", cand.mod, cand.checks);
+			candIndex++;
+		}
+	}
+	candSection += "};\n";
+	lookupSection += "};\n";
+	lookupSection += format("\nconst size_t ADDPR(controllerLookupSize) {%zu};\n", ctrlLookup.size());
+	out.append(candSection);
+	out.append(lookupSection);
+}
+
+/**
+ *  Controller matching benchmark: linear scan as done before ADDPR(controllerLookup) vs the index
+ */
+struct BenchControllerMod {
+	uint32_t vendor;
+	uint32_t device;
+	std::vector<uint32_t> revisions;
+	uint32_t platform;
+	int model;
+};
+
+struct BenchController {
+	uint32_t vendor;
+	uint32_t device;
+	uint32_t revision;
+	uint32_t platform;
+};
+
+static int benchControllers(const std::string &basePath, size_t rounds) {
+	auto vendors = Plist::parseFile(basePath + "/Vendors.plist");
+	auto ctrls = Plist::parseFile(basePath + "/Controllers.plist");
+	if (!vendors.isDict() || !ctrls.isArray())
+		ERROR("Missing resource data (vendors:%d, ctrls:%d)", vendors.isDict(), ctrls.isArray());
+
+	std::vector<BenchControllerMod> mods;
+	std::map<uint32_t, std::vector<ControllerCandidateEntry>> index;
+	for (auto &entry : ctrls.array) {
+		BenchControllerMod mod {};
+		mod.vendor = static_cast<uint16_t>(vendors[entry["Vendor"].string].unsignedValue());
+		mod.device = static_cast<uint16_t>(entry["Device"].unsignedValue());
+		for (auto &r : entry["Revisions"].array)
+			mod.revisions.push_back(static_cast<uint32_t>(r.unsignedValue()));
+		std::sort(mod.revisions.begin(), mod.revisions.end());
+		mod.platform = static_cast<uint32_t>(entry["Platform"].unsignedValue());
+		mod.model = entry["Model"].string == "Laptop" ? 1 : entry["Model"].string == "Desktop" ? 2 : 3;
+		uint32_t checks {0};
+		if (!mod.revisions.empty())
+			checks |= ControllerCheckRevision;
+		if (mod.platform != 0)
+			checks |= ControllerCheckPlatform;
+		index[mod.vendor << 16 | mod.device].push_back({mods.size(), checks});
+		mods.push_back(std::move(mod));
+	}
+
+	struct Bucket { uint32_t id; size_t start; size_t num; };
+	std::vector<Bucket> lookup;
+	std::vector<ControllerCandidateEntry> candidates;
+	for (auto &b : index) {
+		lookup.push_back({b.first, candidates.size(), b.second.size()});
+		candidates.insert(candidates.end(), b.second.begin(), b.second.end());
+	}
+
+	auto linear = [&](const BenchController &c, int model) -> ssize_t {
+		for (size_t m = 0; m < mods.size(); m++) {
+			auto &mod = mods[m];
+			if (c.vendor == mod.vendor && c.device == mod.device) {
+				size_t rev {0};
+				while (rev < mod.revisions.size() && mod.revisions[rev] != c.revision)
+					rev++;
+				if (mod.platform != 0 && mod.platform != c.platform)
+					continue;
+				if (!(model & mod.model))
+					continue;
+				if (rev != mod.revisions.size() || mod.revisions.empty())
+					return static_cast<ssize_t>(m);
+			}
+		}
+		return -1;
+	};
+
+	auto indexed = [&](const BenchController &c, int model) -> ssize_t {
+		uint32_t id = c.vendor << 16 | c.device;
+		auto it = std::lower_bound(lookup.begin(), lookup.end(), id, [](const Bucket &b, uint32_t v) { return b.id < v; });
+		if (it == lookup.end() || it->id != id)
+			return -1;
+		for (size_t i = 0; i < it->num; i++) {
+			auto &cand = candidates[it->start + i];
+			auto &mod = mods[cand.mod];
+			if ((cand.checks & ControllerCheckPlatform) && mod.platform != c.platform)
+				continue;
+			if (!(model & mod.model))
+				continue;
+			if (!(cand.checks & ControllerCheckRevision) ||
+				std::binary_search(mod.revisions.begin(), mod.revisions.end(), c.revision))
+				return static_cast<ssize_t>(cand.mod);
+		}
+		return -1;
+	};
+
+	// Synthetic controller sets: known devices, unknown devices and a mix of both
+	uint32_t seed {0x414C4321};
+	auto rnd = [&seed]() {
+		seed = seed * 1103515245 + 12345;
+		return seed >> 8;
+	};
+
+	std::vector<std::pair<const char *, std::vector<BenchController>>> sets(3);
+	sets[0].first = "known";
+	sets[1].first = "unknown";
+	sets[2].first = "mixed";
+	for (size_t i = 0; i < 4096; i++) {
+		auto &mod = mods[rnd() % mods.size()];
+		uint32_t rev = !mod.revisions.empty() && (rnd() & 1) ? mod.revisions[rnd() % mod.revisions.size()] : rnd() & 0xFF;
+		uint32_t plat = mod.platform != 0 && (rnd() & 1) ? mod.platform : rnd();
+		sets[0].second.push_back({mod.vendor, mod.device, rev, plat});
+		BenchController unknown {0x8086, 0x1000 | (rnd() & 0xFFF), rnd() & 0xFF, 0};
+		sets[1].second.push_back(unknown);
+		sets[2].second.push_back((i & 1) ? sets[0].second.back() : unknown);
+	}
+
+	for (auto &set : sets) {
+		for (int model = 1; model <= 2; model++) {
+			for (auto &c : set.second) {
+				if (linear(c, model) != indexed(c, model))
+					ERROR("Mismatch for %X:%X:%X in %s set", c.vendor, c.device, c.revision, set.first);
+			}
+		}
+
+		volatile ssize_t sink {0};
+		auto measure = [&](ssize_t (*match)(const void *, const BenchController &, int), const void *ctx) {
+			auto start = std::chrono::steady_clock::now();
+			for (size_t r = 0; r < rounds; r++)
+				for (auto &c : set.second)
+					sink = sink + match(ctx, c, 1 + (r & 1));
+			auto end = std::chrono::steady_clock::now();
+			return std::chrono::duration<double, std::nano>(end - start).count() / (rounds * set.second.size());
+		};
+
+		double linearNs = measure([](const void *ctx, const BenchController &c, int m) {
+			return (*static_cast<const decltype(linear) *>(ctx))(c, m);
+		}, &linear);
+		double indexedNs = measure([](const void *ctx, const BenchController &c, int m) {
+			return (*static_cast<const decltype(indexed) *>(ctx))(c, m);
+		}, &indexed);
+
+		SYSLOG("%-8s %zu controllers over %zu mods: linear %.1f ns, indexed %.1f ns per controller (%.1fx)",
+			set.first, set.second.size(), mods.size(), linearNs, indexedNs, linearNs / indexedNs);
+	}
+
+	return 0;
+}
+
+/**
+ *  Compare zlib and LZ4 size and decoding time over every layout and platform
+ */
+static int benchEncodings(const std::string &basePath, size_t rounds) {
+	struct Sample {
+		std::vector<uint8_t> zlib;
+		std::vector<uint8_t> lz4;
+		size_t size;
+	};
+
+	std::vector<Sample> samples;
+	size_t rawBytes {0}, zlibBytes {0}, lz4Bytes {0};
+	for (auto &entry : listDirectory(basePath)) {
+		auto baseDirStr = basePath + "/" + entry;
+		auto infoCfgStr = baseDirStr + "/Info.plist";
+		if (!fileExists(infoCfgStr))
+			continue;
+
+		auto codecDict = Plist::parseFile(infoCfgStr);
+		for (auto kind : {"Layouts", "Platforms"}) {
+			for (auto &file : codecDict["Files"][kind].array) {
+				auto fullInPath = baseDirStr + "/" + file["Path"].string;
+				Sample sample;
+				std::vector<uint8_t> raw;
+				if (!Plist::readFile(fullInPath, sample.zlib) || !inflateData(sample.zlib, raw))
+					ERROR("Failed to read %s", fullInPath.c_str());
+
+				sample.lz4 = LZ4::compress(raw.data(), raw.size());
+				sample.size = raw.size();
+
+				std::vector<uint8_t> check(raw.size());
+				if (ResourcePack::decodeLZ4(sample.lz4.data(), sample.lz4.size(), check.data(), check.size()) != raw.size() || check != raw)
+					ERROR("LZ4 round trip failed for %s", fullInPath.c_str());
+
+				rawBytes += raw.size();
+				zlibBytes += sample.zlib.size();
+				lz4Bytes += sample.lz4.size();
+				samples.push_back(std::move(sample));
+			}
+		}
+	}
+
+	if (samples.empty())
+		ERROR("No resources found in %s", basePath.c_str());
+
+	std::vector<uint8_t> buffer;
+	volatile size_t sink {0};
+
+	auto start = std::chrono::steady_clock::now();
+	for (size_t r = 0; r < rounds; r++) {
+		for (auto &s : samples) {
+			buffer.resize(s.size);
+			uLongf len = s.size;
+			if (uncompress(buffer.data(), &len, s.zlib.data(), s.zlib.size()) != Z_OK)
+				ERROR("zlib decoding failed");
+			sink = sink + len;
+		}
+	}
+	auto zlibTime = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / rounds;
+
+	start = std::chrono::steady_clock::now();
+	for (size_t r = 0; r < rounds; r++) {
+		for (auto &s : samples) {
+			buffer.resize(s.size);
+			sink = sink + ResourcePack::decodeLZ4(s.lz4.data(), s.lz4.size(), buffer.data(), buffer.size());
+		}
+	}
+	auto lz4Time = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / rounds;
+
+	SYSLOG("%zu resources, %zu bytes uncompressed", samples.size(), rawBytes);
+	SYSLOG("zlib %8zu bytes (%5.1f%%), %9.1f us to decode all", zlibBytes, zlibBytes * 100.0 / rawBytes, zlibTime);
+	SYSLOG("lz4  %8zu bytes (%5.1f%%), %9.1f us to decode all", lz4Bytes, lz4Bytes * 100.0 / rawBytes, lz4Time);
+
+	return 0;
+}
+
+/**
+ *  Read a raw pack through the same ResourcePack calls as the kext: header and index first,
+ *  then every entry on its own
+ */
+static int checkPack(const std::string &packFile) {
+	auto f = fopen(packFile.c_str(), "rb");
+	if (!f)
+		ERROR("Failed to open %s", packFile.c_str());
+
+	auto read = [&](uint64_t offset, void *buffer, size_t size) {
+		return fseek(f, static_cast<long>(offset), SEEK_SET) == 0 && fread(buffer, 1, size, f) == size;
+	};
+
+	ResourcePack::Header hdr;
+	size_t fileSize {0};
+	if (fseek(f, 0, SEEK_END) == 0)
+		fileSize = static_cast<size_t>(std::max(0L, ftell(f)));
+	auto indexSize = ResourcePack::readHeader(read, fileSize, hdr);
+	if (indexSize == 0)
+		ERROR("Invalid pack header in %s", packFile.c_str());
+
+	std::vector<ResourcePack::Entry> index((indexSize + sizeof(ResourcePack::Entry) - 1) / sizeof(ResourcePack::Entry));
+	auto idx = ResourcePack::readIndex(read, hdr, reinterpret_cast<uint8_t *>(index.data()), indexSize);
+	if (!idx)
+		ERROR("Invalid pack index in %s, entries have to be sorted by vendor, codec, kind and layout", packFile.c_str());
+
+	auto entries = reinterpret_cast<const ResourcePack::Entry *>(reinterpret_cast<const uint8_t *>(idx) + idx->entryOffset);
+	auto any = [](uint32_t, uint32_t) { return true; };
+	size_t dataBytes {0};
+	for (size_t i = 0; i < idx->entryNum; i++) {
+		auto &e = entries[i];
+		if (e.encoding != ResourcePack::EncodingZlib)
+			ERROR("Entry %zu of %s needs built-in tables (encoding %u)", i, packFile.c_str(), e.encoding);
+		if (!ResourcePack::findStored(idx, e.vendor, e.codec, e.kind, e.layout, any))
+			ERROR("Entry %zu of %s is out of bounds", i, packFile.c_str());
+
+		std::vector<uint8_t> data(e.compressedSize), raw;
+		if (!ResourcePack::readEntry(read, idx, e, data.data()))
+			ERROR("Entry %zu of %s is damaged", i, packFile.c_str());
+		if (!inflateData(data, raw) || raw.size() != e.uncompressedSize)
+			ERROR("Entry %zu of %s does not inflate to %u bytes", i, packFile.c_str(), e.uncompressedSize);
+		dataBytes += data.size();
+	}
+
+	fclose(f);
+	SYSLOG("Checked %u entries with %zu bytes of data, %zu byte index of %zu byte pack", idx->entryNum, dataBytes, indexSize, fileSize);
+	return 0;
+}
+
+static void generateVendors(const Value &vendors, const std::vector<CodecDir> &codecDirs, const std::map<std::string, size_t> &kextIndexes) {
+	std::string vendorSection {"\n// Vendor section\n\n"};
+
+	out.append("#ifdef HAVE_ANALOG_AUDIO\n");
+
+	vendorSection += "const VendorModInfo ADDPR(vendorMod)[] {\n";
+
+	for (size_t v = 0; v < vendors.dict.size(); v++) {
+		auto &vendor = vendors.dict[v];
+		auto vendorID = static_cast<uint16_t>(vendor.second.unsignedValue());
+		size_t start = codecModNum;
+		size_t num = generateCodecs(vendor.first, v, vendorID, codecDirs, kextIndexes);
+		vendorSection += format("\t{ %s, 0x%X, { %zu }, %zu },\n",
+			generateName(vendor.first).c_str(), vendorID, start, num);
+	}
+
+	vendorSection += "};\n";
+	vendorSection += format("\nconst size_t ADDPR(vendorModSize) {%zu};\n", vendors.count());
+
+	out.append("\n// CodecMod section\n\n");
+	out.append("const CodecModInfo ADDPR(codecMod)[] {\n");
+	out.append(codecModNum > 0 ? codecModSection : "\t{},\n");
+	out.append("};\n");
+	out.append(vendorSection);
+
+	// Sorted codec index, the first codec directory wins for duplicate ids like the linear scan did
+	std::stable_sort(codecLookup.begin(), codecLookup.end(), [](const CodecLookupEntry &a, const CodecLookupEntry &b) {
+		return a.id < b.id;
+	});
+	codecLookup.erase(std::unique(codecLookup.begin(), codecLookup.end(), [](const CodecLookupEntry &a, const CodecLookupEntry &b) {
+		return a.id == b.id;
+	}), codecLookup.end());
+
+	std::string lookupSection {"\n// Codec lookup section\n\n"};
+	lookupSection += "const CodecLookupInfo ADDPR(codecLookup)[] {\n";
+	for (auto &e : codecLookup) {
+		lookupSection += format("\t{ 0x%08X, { %zu }, { %zu } },\n", e.id, e.vendor, e.codec);
+	}
+	lookupSection += "};\n";
+	lookupSection += format("\nconst size_t ADDPR(codecLookupSize) {%zu};\n", codecLookup.size());
+	out.append(lookupSection);
+	out.append("#endif\n");
+}
+
+/**
+ *  Emit ADDPR(pinConfigLookup), HDAConfigDefault entry indexes of the PinConfigs personality sorted by codec and layout.
+ *  Entries sharing a key keep their plist order, so the first one still wins.
+ *  ConfigData and WakeConfigData are compiled into ADDPR(pinConfigVerbs) along with the size and checksum
+ *  of their source, programs that compile to the original bytes are not stored.
+ */
+static void generatePinConfigs(const std::string &basePath) {
+	auto pinCfg = basePath + "/PinConfigs.kext/Contents/Info.plist";
+	auto pinConfigs = Plist::parseFile(pinCfg);
+	auto &configList = pinConfigs["IOKitPersonalities"]["as.vit9696.AppleALC"]["HDAConfigDefault"];
+	if (!configList.isArray())
+		ERROR("Missing HDAConfigDefault in %s", pinCfg.c_str());
+
+	struct PinConfigEntry {
+		uint32_t codec;
+		uint32_t layout;
+		uint32_t index;
+		const Value *config;
+	};
+
+	std::vector<PinConfigEntry> entries;
+	for (size_t i = 0; i < configList.array.size(); i++) {
+		auto &config = configList.array[i];
+		if (config["CodecID"] && config["LayoutID"])
+			entries.push_back({static_cast<uint32_t>(config["CodecID"].unsignedValue()),
+				static_cast<uint32_t>(config["LayoutID"].unsignedValue()), static_cast<uint32_t>(i), &config});
+	}
+
+	std::stable_sort(entries.begin(), entries.end(), [](const PinConfigEntry &a, const PinConfigEntry &b) {
+		return a.codec != b.codec ? a.codec < b.codec : a.layout < b.layout;
+	});
+	entries.erase(std::unique(entries.begin(), entries.end(), [](const PinConfigEntry &a, const PinConfigEntry &b) {
+		return a.codec == b.codec && a.layout == b.layout;
+	}), entries.end());
+
+	std::vector<uint8_t> verbArena;
+	size_t verbsBefore {0}, verbsAfter {0};
+	auto compileVerbs = [&](const PinConfigEntry &e, const char *key) {
+		auto &data = (*e.config)[key];
+		if (!data.isData())
+			return std::string("0, 0, 0, 0");
+
+		std::vector<uint8_t> program;
+		std::string error;
+		if (!Verbs::compile(data.data, program, error)) {
+			// AppleHDA replays verbs hda_verbs does not know, such streams are only left uncompiled
+			SYSLOG("Keeping %s for codec %08X layout %u uncompiled: %s", key, e.codec, e.layout, error.c_str());
+			verbsBefore += data.data.size() / sizeof(uint32_t);
+			verbsAfter += data.data.size() / sizeof(uint32_t);
+			return std::string("0, 0, 0, 0");
+		}
+		verbsBefore += data.data.size() / sizeof(uint32_t);
+		verbsAfter += program.size() / sizeof(uint32_t);
+		if (program == data.data)
+			return std::string("0, 0, 0, 0");
+
+		// The kext installs the program only while PinConfigs still has the stream it was compiled from
+		auto start = verbArena.size();
+		verbArena.insert(verbArena.end(), program.begin(), program.end());
+		return format("%zu, %zu, %zu, 0x%08X", start, program.size(), data.data.size(),
+					  ResourcePack::checksum(data.data.data(), data.data.size()));
+	};
+
+	std::string lookupSection {"\n// Pin config lookup section\n\n#ifdef HAVE_ANALOG_AUDIO\n"};
+	if (entries.empty()) {
+		lookupSection += "const PinConfigLookupInfo ADDPR(pinConfigLookup)[1] {};\n";
+	} else {
+		lookupSection += "const PinConfigLookupInfo ADDPR(pinConfigLookup)[] {\n";
+		for (auto &e : entries) {
+			auto config = compileVerbs(e, "ConfigData");
+			auto wake = compileVerbs(e, "WakeConfigData");
+			lookupSection += format("\t{ 0x%08X, %u, %u, %s, %s },\n", e.codec, e.layout, e.index, config.c_str(), wake.c_str());
+		}
+		lookupSection += "};\n";
+	}
+	lookupSection += format("\nconst size_t ADDPR(pinConfigLookupSize) {%zu};\n", entries.size());
+
+	if (verbArena.empty()) {
+		lookupSection += "\nconst uint8_t ADDPR(pinConfigVerbs)[1] {};\n";
+		out.append(lookupSection);
+	} else {
+		lookupSection += "\nconst uint8_t ADDPR(pinConfigVerbs)[] {\n";
+		out.append(lookupSection);
+		out.appendBytes(verbArena.data(), verbArena.size());
+		out.append("};\n");
+	}
+	out.append("#endif\n");
+
+	SYSLOG("Compiled pin configs from %zu to %zu verbs", verbsBefore, verbsAfter);
+}
+
+/**
+ *  Kernel range AppleALC loads on, keep in sync with ADDPR(config) in kern_start.cpp (Tiger...Sonoma)
+ */
+static constexpr uint32_t PluginKernelMin {8};
+static constexpr uint32_t PluginKernelMax {23};
+
+/**
+ *  Whether an entry with the given kernel bounds can never be used by the plugin
+ */
+static bool outsidePluginRange(const Value &entry) {
+	auto minKernel = entry["MinKernel"] ? static_cast<uint32_t>(entry["MinKernel"].unsignedValue()) : 0;
+	auto maxKernel = entry["MaxKernel"] ? static_cast<uint32_t>(entry["MaxKernel"].unsignedValue()) : 0;
+	return (maxKernel != 0 && maxKernel < PluginKernelMin) || (minKernel != 0 && minKernel > PluginKernelMax);
+}
+
+static std::string jsonString(const std::string &str) {
+	std::string r {"\""};
+	for (unsigned char c : str) {
+		if (c == '"' || c == '\\')
+			r += format("\\%c", c);
+		else if (c < 0x20)
+			r += format("\\u%04X", c);
+		else
+			r += static_cast<char>(c);
+	}
+	return r + "\"";
+}
+
+/**
+ *  Resource footprint of one codec, controller or vendor
+ */
+struct ReportUsage {
+	size_t layoutNum {0}, layoutBytes {0}, layoutRawBytes {0};
+	size_t platformNum {0}, platformBytes {0}, platformRawBytes {0};
+	size_t patchNum {0}, patchBytes {0};
+	size_t duplicateBytes {0};
+	size_t outsideKernelNum {0};
+
+	void add(const ReportUsage &u) {
+		layoutNum += u.layoutNum;
+		layoutBytes += u.layoutBytes;
+		layoutRawBytes += u.layoutRawBytes;
+		platformNum += u.platformNum;
+		platformBytes += u.platformBytes;
+		platformRawBytes += u.platformRawBytes;
+		patchNum += u.patchNum;
+		patchBytes += u.patchBytes;
+		duplicateBytes += u.duplicateBytes;
+		outsideKernelNum += u.outsideKernelNum;
+	}
+
+	std::string json() const {
+		return format("\"layouts\": {\"count\": %zu, \"compressed\": %zu, \"uncompressed\": %zu}, "
+			"\"platforms\": {\"count\": %zu, \"compressed\": %zu, \"uncompressed\": %zu}, "
+			"\"patches\": {\"count\": %zu, \"bytes\": %zu}, \"duplicateBytes\": %zu, \"outsideKernelRange\": %zu",
+			layoutNum, layoutBytes, layoutRawBytes, platformNum, platformBytes, platformRawBytes,
+			patchNum, patchBytes, duplicateBytes, outsideKernelNum);
+	}
+};
+
+static void reportPatches(const Value &patches, ReportUsage &usage) {
+	for (auto &p : patches.array) {
+		usage.patchNum++;
+		usage.patchBytes += p["Find"].data.size() + p["Replace"].data.size();
+		if (outsidePluginRange(p))
+			usage.outsideKernelNum++;
+	}
+}
+
+/**
+ *  Write a JSON footprint report next to the generated sources.
+ *  Duplicate bytes count files identical to one seen earlier in codec directory order,
+ *  these are stored once in the kext.
+ */
+static void generateReport(const std::string &outputCpp, const Value &vendors, const Value &ctrls, const std::vector<CodecDir> &codecDirs) {
+	struct FileInfo {
+		uint64_t hash;
+		size_t size;
+	};
+
+	std::vector<ReportUsage> usages(codecDirs.size());
+	std::vector<std::vector<FileInfo>> files(codecDirs.size());
+
+	parallelFor(codecDirs.size(), [&](size_t i) {
+		auto &dir = codecDirs[i];
+		auto &usage = usages[i];
+		for (auto kind : {ResourcePack::KindLayout, ResourcePack::KindPlatform}) {
+			auto &list = dir.dict["Files"][kind == ResourcePack::KindLayout ? "Layouts" : "Platforms"];
+			for (auto &file : list.array) {
+				std::vector<uint8_t> data, raw;
+				if (!Plist::readFile(dir.path + "/" + file["Path"].string, data))
+					continue;
+				inflateData(data, raw);
+				auto &num = kind == ResourcePack::KindLayout ? usage.layoutNum : usage.platformNum;
+				auto &bytes = kind == ResourcePack::KindLayout ? usage.layoutBytes : usage.platformBytes;
+				auto &rawBytes = kind == ResourcePack::KindLayout ? usage.layoutRawBytes : usage.platformRawBytes;
+				num++;
+				bytes += data.size();
+				rawBytes += raw.size();
+				if (outsidePluginRange(file))
+					usage.outsideKernelNum++;
+				files[i].push_back({hashBytes(data.data(), data.size()), data.size()});
+			}
+		}
+		reportPatches(dir.dict["Patches"], usage);
+	});
+
+	std::map<std::pair<uint64_t, size_t>, size_t> seen;
+	for (size_t i = 0; i < codecDirs.size(); i++) {
+		for (auto &f : files[i]) {
+			if (!seen.emplace(std::make_pair(f.hash, f.size), i).second)
+				usages[i].duplicateBytes += f.size;
+		}
+	}
+
+	OutputWriter report;
+	report.openDeferred(reportPath(outputCpp));
+	ReportUsage total;
+
+	report.append("{\n\t\"vendors\": [\n");
+	for (size_t v = 0; v < vendors.dict.size(); v++) {
+		auto &vendor = vendors.dict[v];
+		ReportUsage vendorUsage;
+		std::string codecSection;
+		for (size_t i = 0; i < codecDirs.size(); i++) {
+			auto &dict = codecDirs[i].dict;
+			if (dict["Vendor"].string != vendor.first)
+				continue;
+			vendorUsage.add(usages[i]);
+			codecSection += format("%s\t\t\t\t{\"name\": %s, \"directory\": %s, \"codec\": %llu, %s}",
+				codecSection.empty() ? "" : ",\n", jsonString(dict["CodecName"].string).c_str(),
+				jsonString(codecDirs[i].name).c_str(), static_cast<unsigned long long>(dict["CodecID"].unsignedValue()),
+				usages[i].json().c_str());
+		}
+		total.add(vendorUsage);
+		report.appendf("\t\t{\"name\": %s, \"vendor\": %llu, %s, \"codecs\": [\n%s\n\t\t]}%s\n",
+			jsonString(vendor.first).c_str(), static_cast<unsigned long long>(vendor.second.unsignedValue()),
+			vendorUsage.json().c_str(), codecSection.c_str(), v + 1 < vendors.dict.size() ? "," : "");
+	}
+
+	report.append("\t],\n\t\"controllers\": [\n");
+	for (size_t i = 0; i < ctrls.array.size(); i++) {
+		auto &entry = ctrls.array[i];
+		ReportUsage usage;
+		reportPatches(entry["Patches"], usage);
+		total.add(usage);
+		report.appendf("\t\t{\"name\": %s, \"vendor\": %s, \"device\": %llu, %s}%s\n",
+			jsonString(entry["Name"].string).c_str(), jsonString(entry["Vendor"].string).c_str(),
+			static_cast<unsigned long long>(entry["Device"].unsignedValue()), usage.json().c_str(),
+			i + 1 < ctrls.array.size() ? "," : "");
+	}
+
+	report.appendf("\t],\n\t\"kernelRange\": [%u, %u],\n\t\"patchArenaBytes\": %zu,\n\t\"total\": {%s}\n}\n",
+		PluginKernelMin, PluginKernelMax, patchArena.size(), total.json().c_str());
+
+	if (!report.close())
+		ERROR("Failed to write %s", reportPath(outputCpp).c_str());
+}
+
+/**
+ *  Recursively collect files ending with suffix, in sorted order
+ */
+static void findFiles(const std::string &path, const char *suffix, std::vector<std::string> &files) {
+	size_t suffixLen = strlen(suffix);
+	for (auto &name : listDirectory(path)) {
+		auto full = path + "/" + name;
+		struct stat st;
+		if (stat(full.c_str(), &st) != 0)
+			continue;
+		if (S_ISDIR(st.st_mode))
+			findFiles(full, suffix, files);
+		else if (name.size() > suffixLen && name.compare(name.size() - suffixLen, suffixLen, suffix) == 0)
+			files.push_back(full);
+	}
+}
+
+static bool writeFile(const std::string &path, const void *data, size_t size) {
+	OutputWriter file;
+	if (!file.open(path))
+		return false;
+	file.append(std::string(static_cast<const char *>(data), size));
+	return file.close();
+}
+
+/**
+ *  Replace Tools/zlib.pl: canonicalise and deflate every layout and platform XML.
+ *  Files whose .zlib.md5 stamp still matches the XML are skipped unless forced.
+ *  Stamps keep the md5(1) based format written by Tools/zlib_pack.command.
+ *
+ *  @param basePath   Resources directory
+ *  @param force      repack everything
+ *  @param iterations deflate cost model refinements
+ */
+static int packXml(const std::string &basePath, bool force, size_t iterations) {
+	std::vector<std::string> files;
+	findFiles(basePath, ".xml", files);
+
+	std::vector<size_t> before(files.size()), after(files.size());
+	std::atomic<size_t> failed {0};
+	auto start = std::chrono::steady_clock::now();
+
+	parallelFor(files.size(), [&](size_t i) {
+		auto &xml = files[i];
+		auto zlibFile = xml + ".zlib", stampFile = zlibFile + ".md5";
+
+		std::vector<uint8_t> data, oldStamp;
+		if (!Plist::readFile(xml, data)) {
+			SYSLOG("Failed to read %s", xml.c_str());
+			failed++;
+			return;
+		}
+
+		auto stamp = " " + MD5::hex(data.data(), data.size()) + "\n";
+		if (!force && fileExists(zlibFile) && Plist::readFile(stampFile, oldStamp) &&
+			std::string(oldStamp.begin(), oldStamp.end()) == stamp)
+			return;
+
+		auto text = Plist::canonicalize(reinterpret_cast<const char *>(data.data()), data.size());
+		auto packed = Deflate::compress(reinterpret_cast<const uint8_t *>(text.data()), text.size(), iterations);
+		if (!writeFile(zlibFile, packed.data(), packed.size()) || !writeFile(stampFile, stamp.data(), stamp.size())) {
+			SYSLOG("Failed to write %s", zlibFile.c_str());
+			failed++;
+			return;
+		}
+
+		before[i] = data.size();
+		after[i] = packed.size();
+		SYSLOG("Packed %s", xml.c_str());
+	});
+
+	size_t num {0}, beforeBytes {0}, afterBytes {0};
+	for (size_t i = 0; i < files.size(); i++) {
+		if (after[i] > 0) {
+			num++;
+			beforeBytes += before[i];
+			afterBytes += after[i];
+		}
+	}
+
+	double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	SYSLOG("Packed %zu of %zu files, %zu -> %zu bytes in %.1f s", num, files.size(), beforeBytes, afterBytes, secs);
+	return failed > 0;
+}
+
+/**
+ *  Inflate every .xml.zlib back into its .xml, see Tools/zlib_unpack.command
+ *
+ *  @param basePath   Resources directory
+ */
+static int unpackXml(const std::string &basePath) {
+	std::vector<std::string> files;
+	findFiles(basePath, ".xml.zlib", files);
+
+	std::atomic<size_t> failed {0};
+	parallelFor(files.size(), [&](size_t i) {
+		auto &zlibFile = files[i];
+		auto xml = zlibFile.substr(0, zlibFile.size() - strlen(".zlib"));
+		std::vector<uint8_t> data, raw;
+		if (!Plist::readFile(zlibFile, data) || !inflateData(data, raw) || !writeFile(xml, raw.data(), raw.size())) {
+			SYSLOG("Failed to decompress %s", zlibFile.c_str());
+			failed++;
+			return;
+		}
+		SYSLOG("Decompressed %s", zlibFile.c_str());
+	});
+
+	return failed > 0;
+}
+
+/**
+ *  Replace the plutil and perl passes of generate.sh: lay out every plist and xml
+ *  like plutil -convert xml1 with <data> joined into one line. Layout and platform
+ *  xmls lose their plist wrapper. Formatted file hashes are kept in one manifest,
+ *  files still matching it are neither read past hashing nor rewritten.
+ *
+ *  @param basePath     Resources directory
+ *  @param manifestFile manifest path
+ *  @param force        reformat everything
+ */
+static int formatPlists(const std::string &basePath, const std::string &manifestFile, bool force) {
+	std::vector<std::string> files;
+	findFiles(basePath, ".plist", files);
+	findFiles(basePath, ".xml", files);
+	std::sort(files.begin(), files.end());
+
+	std::map<std::string, std::string> known;
+	if (auto f = fopen(manifestFile.c_str(), "r")) {
+		char hash[33], name[4096];
+		while (fscanf(f, "%32s %4095[^\n]\n", hash, name) == 2)
+			known[name] = hash;
+		fclose(f);
+	}
+
+	std::vector<std::string> hashes(files.size());
+	std::atomic<size_t> failed {0}, formatted {0};
+
+	parallelFor(files.size(), [&](size_t i) {
+		auto &path = files[i];
+		auto name = path.substr(basePath.size() + 1);
+
+		std::vector<uint8_t> data;
+		if (!Plist::readFile(path, data)) {
+			SYSLOG("Failed to read %s", path.c_str());
+			failed++;
+			return;
+		}
+
+		hashes[i] = MD5::hex(data.data(), data.size());
+		auto it = known.find(name);
+		if (!force && it != known.end() && it->second == hashes[i])
+			return;
+
+		std::string text;
+		bool header = name.size() > 6 && name.compare(name.size() - 6, 6, ".plist") == 0;
+		if (!Plist::format(reinterpret_cast<const char *>(data.data()), data.size(), header, text)) {
+			SYSLOG("Failed to format %s", path.c_str());
+			failed++;
+			return;
+		}
+
+		OutputWriter file;
+		file.openDeferred(path);
+		file.append(text);
+		if (!file.close()) {
+			SYSLOG("Failed to write %s", path.c_str());
+			failed++;
+			return;
+		}
+
+		hashes[i] = MD5::hex(reinterpret_cast<const uint8_t *>(text.data()), text.size());
+		if (file.wasChanged()) {
+			formatted++;
+			SYSLOG("Reformatted %s", path.c_str());
+		}
+	});
+
+	// Failed files are left out so that they are retried next time
+	OutputWriter manifest;
+	manifest.openDeferred(manifestFile);
+	for (size_t i = 0; i < files.size(); i++) {
+		if (!hashes[i].empty())
+			manifest.appendf("%s %s\n", hashes[i].c_str(), files[i].substr(basePath.size() + 1).c_str());
+	}
+	if (!manifest.close())
+		ERROR("Failed to write %s", manifestFile.c_str());
+
+	SYSLOG("Reformatted %zu of %zu files", formatted.load(), files.size());
+	return failed > 0;
+}
+
+int main(int argc, const char * argv[]) {
+	if (argc >= 3 && !strcmp(argv[1], "--bench-controllers"))
+		return benchControllers(argv[2], argc > 3 ? strtoul(argv[3], nullptr, 0) : 1000);
+	if (argc >= 3 && !strcmp(argv[1], "--bench-encodings"))
+		return benchEncodings(argv[2], argc > 3 ? strtoul(argv[3], nullptr, 0) : 100);
+	if (argc == 3 && !strcmp(argv[1], "--check-pack"))
+		return checkPack(argv[2]);
+
+	// ResourceConverter --zlib-pack <Resources> [--force] [--iterations N] [--jobs N]
+	// ResourceConverter --zlib-unpack <Resources> [--jobs N]
+	if (argc >= 3 && (!strcmp(argv[1], "--zlib-pack") || !strcmp(argv[1], "--zlib-unpack"))) {
+		bool force {false};
+		size_t iterations {15};
+		for (int i = 3; i < argc; i++) {
+			if (!strcmp(argv[i], "--force"))
+				force = true;
+			else if (!strcmp(argv[i], "--iterations") && i + 1 < argc)
+				iterations = strtoul(argv[++i], nullptr, 0);
+			else if (!strcmp(argv[i], "--jobs") && i + 1 < argc)
+				jobCount = std::max(1UL, strtoul(argv[++i], nullptr, 0));
+			else
+				ERROR("Invalid usage");
+		}
+		return !strcmp(argv[1], "--zlib-pack") ? packXml(argv[2], force, iterations) : unpackXml(argv[2]);
+	}
+
+	// ResourceConverter --format <Resources> <manifest> [--force] [--jobs N]
+	if (argc >= 4 && !strcmp(argv[1], "--format")) {
+		bool force {false};
+		for (int i = 4; i < argc; i++) {
+			if (!strcmp(argv[i], "--force"))
+				force = true;
+			else if (!strcmp(argv[i], "--jobs") && i + 1 < argc)
+				jobCount = std::max(1UL, strtoul(argv[++i], nullptr, 0));
+			else
+				ERROR("Invalid usage");
+		}
+		return formatPlists(argv[2], argv[3], force);
+	}
+
+	// ResourceConverter --train-dict <Resources> <dictionary> [--jobs N]
+	if (argc >= 4 && !strcmp(argv[1], "--train-dict")) {
+		for (int i = 4; i < argc; i++) {
+			if (!strcmp(argv[i], "--jobs") && i + 1 < argc)
+				jobCount = std::max(1UL, strtoul(argv[++i], nullptr, 0));
+			else
+				ERROR("Invalid usage");
+		}
+		trainDictionary(loadCodecDirs(argv[2]));
+		writeDictionary(argv[3]);
+		SYSLOG("Trained %zu byte preset dictionary", packDictionary.size());
+		return 0;
+	}
+
+	// ResourceConverter --train-tables <Resources> <tables> [--jobs N]
+	if (argc >= 4 && !strcmp(argv[1], "--train-tables")) {
+		for (int i = 4; i < argc; i++) {
+			if (!strcmp(argv[i], "--jobs") && i + 1 < argc)
+				jobCount = std::max(1UL, strtoul(argv[++i], nullptr, 0));
+			else
+				ERROR("Invalid usage");
+		}
+		trainTables(loadCodecDirs(argv[2]));
+		writeTables(argv[3]);
+		SYSLOG("Trained %zu dictionary keys and %zu shared PathMaps", keyTable.size(), sharedSubtreeOffsets.size());
+		return 0;
+	}
+
+	// ResourceConverter <Resources> <kern_resources.cpp> [--jobs N] [--incbin <dir>] [--pack [--lz4] [--binary [--tables <tables>]] [--dict <dictionary>] [--delta] [resources.pack]]
+	if (argc < 3)
+		ERROR("Invalid usage");
+
+	std::string packFile;
+	for (int i = 3; i < argc; i++) {
+		if (!strcmp(argv[i], "--pack"))
+			packMode = true;
+		else if (!strcmp(argv[i], "--lz4"))
+			packLZ4 = true;
+		else if (!strcmp(argv[i], "--binary"))
+			packBinary = true;
+		else if (!strcmp(argv[i], "--tables") && i + 1 < argc)
+			packTablesFile = argv[++i];
+		else if (!strcmp(argv[i], "--dict") && i + 1 < argc) {
+			packDict = true;
+			packDictFile = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--delta"))
+			packDelta = true;
+		else if (!strcmp(argv[i], "--jobs") && i + 1 < argc)
+			jobCount = std::max(1UL, strtoul(argv[++i], nullptr, 0));
+		else if (!strcmp(argv[i], "--incbin") && i + 1 < argc)
+			blobDir = argv[++i];
+		else if (packMode && packFile.empty())
+			packFile = argv[i];
+		else
+			ERROR("Invalid usage");
+	}
+	packExternal = !packFile.empty();
+
+	if ((packLZ4 || packBinary || packDict || packDelta) && !packMode)
+		ERROR("LZ4, binary, dictionary and delta encodings require --pack");
+	if (!packTablesFile.empty() && !packBinary)
+		ERROR("Binary tables require --binary");
+
+	std::string basePath {argv[1]};
+	auto vendorsCfg = basePath + "/Vendors.plist";
+	auto kextsCfg = basePath + "/Kexts.plist";
+	auto ctrlsCfg = basePath + "/Controllers.plist";
+	//auto userCfg = basePath + "/UserPatches.plist";
+	std::string outputCpp {argv[2]};
+
+	auto vendors = Plist::parseFile(vendorsCfg);
+	auto kexts = Plist::parseFile(kextsCfg);
+	auto ctrls = Plist::parseFile(ctrlsCfg);
+	//auto userp = Plist::parseFile(userCfg);
+
+	if (!vendors.isDict() || !kexts.isDict() || !ctrls.isArray())
+		ERROR("Missing resource data (vendors:%d, kexts:%d, ctrls:%d)", vendors.isDict(), kexts.isDict(), ctrls.isArray());
+
+	// Emit vendors and kexts in key order, reordering a plist must not change the output
+	for (auto dict : {&vendors, &kexts}) {
+		std::sort(dict->dict.begin(), dict->dict.end(), [](const std::pair<std::string, Value> &a, const std::pair<std::string, Value> &b) {
+			return a.first < b.first;
+		});
+	}
+
+	// Only shards with changed inputs are regenerated, a raw pack needs all of them
+	auto codecDirs = loadCodecDirs(basePath);
+	std::string options = format("generator:%u format:%u entry:%zu pack:%d lz4:%d binary:%d delta:%d incbin:%s", GeneratorRevision,
+		ResourcePack::Version, sizeof(ResourcePack::Entry), packMode, packLZ4, packBinary, packDelta, blobDir.c_str());
+	if (packBinary) {
+		// Every shard depends on the key and shared subtree tables, they only change when retrained
+		std::vector<uint8_t> tables;
+		if (!packTablesFile.empty()) {
+			readTables(packTablesFile);
+			if (!Plist::readFile(packTablesFile, tables))
+				ERROR("Failed to read %s", packTablesFile.c_str());
+		}
+		options += format(" tables:%016llx", static_cast<unsigned long long>(hashBytes(tables.data(), tables.size())));
+	}
+	if (packDict) {
+		// Every shard depends on the dictionary, it only changes when retrained
+		readDictionary(packDictFile);
+		options += format(" dict:%016llx", static_cast<unsigned long long>(hashBytes(packDictionary.data(), packDictionary.size())));
+	}
+	hashShardInputs(codecDirs, options);
+	if (packFile.empty())
+		readManifest(outputCpp);
+
+	if (!blobDir.empty() && mkdir(blobDir.c_str(), 0755) != 0 && errno != EEXIST)
+		ERROR("Failed to create %s", blobDir.c_str());
+
+	// Unchanged sources are left untouched to avoid recompiling them
+	out.openDeferred(outputCpp);
+
+	size_t shardsWritten {0};
+	try {
+		out.append(ResourceHeader);
+		auto kextIndexes = generateKexts(kexts);
+		generateVendors(vendors, codecDirs, kextIndexes);
+		generateControllers(ctrls, vendors, kextIndexes);
+		generatePinConfigs(basePath);
+		generateArenas();
+		generatePatchArena();
+		generatePatchBuckets();
+		shardsWritten = generateResourcePacks(outputCpp, packFile);
+	} catch (...) {
+		ERROR("Fatal error during generation");
+	}
+
+	if (!out.close())
+		ERROR("Failed to write %s", outputCpp.c_str());
+
+	writeManifest(outputCpp);
+	if (!blobDir.empty()) {
+		std::vector<std::string> sources {outputCpp};
+		for (size_t i = 0; i < ShardCount; i++)
+			sources.push_back(shardPath(outputCpp, i));
+		pruneBlobs(sources);
+	}
+	generateReport(outputCpp, vendors, ctrls, codecDirs);
+
+	SYSLOG("Deduplicated %zu files saving %zu bytes", dedupFileNum, dedupFileBytes);
+	SYSLOG("Packed %zu bytes of unique patch data into %zu byte arena", patchBufBytes, patchArena.size());
+	if (packMode) {
+		size_t entryNum {0}, dataSize {0};
+		for (auto &shard : packShards) {
+			entryNum += shard.entries.size();
+			dataSize += shard.data.size();
+		}
+		SYSLOG("Stored %zu resources in %zu bytes of pack data", entryNum, dataSize);
+		if (packDict)
+			SYSLOG("Loaded %zu byte preset dictionary", packDictionary.size());
+		if (packBinary)
+			SYSLOG("Shared %zu PathMaps in %zu bytes and %zu dictionary keys", sharedSubtreeOffsets.size(), sharedSubtrees.size(), keyTable.size());
 	}
+	SYSLOG("Updated %s and %zu of %zu shards", out.wasChanged() ? "index" : "no index", shardsWritten, ShardCount);
 }
@@ -0,0 +1,108 @@
+//
+//  md5.hpp
+//  ResourceConverter
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+
+// MD5 digest matching md5(1) output, used for the .md5 stamps the
+// build scripts keep next to packed resources.
+
+#ifndef md5_hpp
+#define md5_hpp
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace MD5 {
+
+static inline uint32_t rotate(uint32_t v, uint32_t n) {
+	return (v << n) | (v >> (32 - n));
+}
+
+static inline void transform(uint32_t state[4], const uint8_t block[64]) {
+	static const uint32_t K[64] {
+		0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+		0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+		0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+		0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+		0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+		0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+		0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+		0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+	};
+	static const uint32_t S[16] {7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21};
+
+	uint32_t m[16];
+	for (size_t i = 0; i < 16; i++)
+		m[i] = block[i*4] | (block[i*4+1] << 8) | (block[i*4+2] << 16) | (static_cast<uint32_t>(block[i*4+3]) << 24);
+
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+	for (uint32_t i = 0; i < 64; i++) {
+		uint32_t f, g;
+		if (i < 16) {
+			f = (b & c) | (~b & d);
+			g = i;
+		} else if (i < 32) {
+			f = (d & b) | (~d & c);
+			g = (5 * i + 1) % 16;
+		} else if (i < 48) {
+			f = b ^ c ^ d;
+			g = (3 * i + 5) % 16;
+		} else {
+			f = c ^ (b | ~d);
+			g = (7 * i) % 16;
+		}
+		uint32_t tmp = d;
+		d = c;
+		c = b;
+		b = b + rotate(a + f + K[i] + m[g], S[(i / 16) * 4 + i % 4]);
+		a = tmp;
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+}
+
+/**
+ *  Lowercase hex digest of a buffer
+ *
+ *  @param data  bytes
+ *  @param size  byte count
+ */
+static inline std::string hex(const uint8_t *data, size_t size) {
+	uint32_t state[4] {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+
+	size_t i = 0;
+	for (; i + 64 <= size; i += 64)
+		transform(state, data + i);
+
+	uint8_t tail[128] {};
+	size_t rest = size - i;
+	memcpy(tail, data + i, rest);
+	tail[rest] = 0x80;
+	size_t tailSize = rest < 56 ? 64 : 128;
+	uint64_t bits = static_cast<uint64_t>(size) * 8;
+	for (size_t b = 0; b < 8; b++)
+		tail[tailSize - 8 + b] = static_cast<uint8_t>(bits >> (b * 8));
+	for (size_t b = 0; b < tailSize; b += 64)
+		transform(state, tail + b);
+
+	static const char digits[] = "0123456789abcdef";
+	std::string out;
+	for (size_t w = 0; w < 4; w++) {
+		for (size_t b = 0; b < 4; b++) {
+			uint8_t v = static_cast<uint8_t>(state[w] >> (b * 8));
+			out += digits[v >> 4];
+			out += digits[v & 0xF];
+		}
+	}
+	return out;
+}
+
+}
+
+#endif /* md5_hpp */
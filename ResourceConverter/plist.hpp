@@ -0,0 +1,595 @@
+//
+//  plist.hpp
+//  ResourceConverter
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+
+// Minimal portable XML property list reader. It replaces Foundation's
+// NSDictionary/NSArray loaders so that resources can be generated on
+// any build host. Only the subset produced by plutil is supported:
+// dict, array, key, string, integer, real, true, false, data and date.
+// Headerless fragments (layout and platform XMLs) are accepted as well.
+
+#ifndef plist_hpp
+#define plist_hpp
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Plist {
+
+struct Value {
+	enum class Type {
+		None,
+		Dict,
+		Array,
+		String,
+		Integer,
+		Real,
+		Boolean,
+		Data,
+		Date
+	};
+
+	Type type {Type::None};
+
+	std::string string;
+	int64_t integer {0};
+	double real {0};
+	bool boolean {false};
+	std::vector<uint8_t> data;
+	std::vector<Value> array;
+	std::vector<std::pair<std::string, Value>> dict;
+
+	explicit operator bool() const { return type != Type::None; }
+
+	bool isDict() const { return type == Type::Dict; }
+	bool isArray() const { return type == Type::Array; }
+	bool isString() const { return type == Type::String; }
+	bool isInteger() const { return type == Type::Integer; }
+	bool isData() const { return type == Type::Data; }
+
+	/**
+	 *  Dictionary lookup, returns an empty value when missing
+	 */
+	const Value &operator[](const char *key) const {
+		static const Value none;
+		if (type == Type::Dict) {
+			for (auto &kv : dict)
+				if (kv.first == key)
+					return kv.second;
+		}
+		return none;
+	}
+
+	const Value &operator[](const std::string &key) const {
+		return (*this)[key.c_str()];
+	}
+
+	/**
+	 *  Number of array or dictionary elements
+	 */
+	size_t count() const {
+		if (type == Type::Array)
+			return array.size();
+		if (type == Type::Dict)
+			return dict.size();
+		return 0;
+	}
+
+	uint64_t unsignedValue() const {
+		if (type == Type::Integer)
+			return static_cast<uint64_t>(integer);
+		if (type == Type::Real)
+			return static_cast<uint64_t>(real);
+		if (type == Type::Boolean)
+			return boolean;
+		return 0;
+	}
+};
+
+class Parser {
+	const char *cur;
+	const char *end;
+	std::string error;
+
+	void skipSpace() {
+		while (cur < end && (*cur == ' ' || *cur == '\t' || *cur == '\r' || *cur == '\n'))
+			cur++;
+	}
+
+	bool startsWith(const char *s) const {
+		size_t len = strlen(s);
+		return static_cast<size_t>(end - cur) >= len && memcmp(cur, s, len) == 0;
+	}
+
+	bool skipPast(const char *s) {
+		size_t len = strlen(s);
+		while (cur < end) {
+			if (startsWith(s)) {
+				cur += len;
+				return true;
+			}
+			cur++;
+		}
+		return false;
+	}
+
+	/**
+	 *  Skip prolog, doctype, comments and the plist wrapper
+	 */
+	void skipMisc() {
+		while (true) {
+			skipSpace();
+			if (startsWith("<?")) {
+				skipPast("?>");
+			} else if (startsWith("<!--")) {
+				skipPast("-->");
+			} else if (startsWith("<!")) {
+				skipPast(">");
+			} else if (startsWith("<plist") || startsWith("</plist")) {
+				skipPast(">");
+			} else {
+				break;
+			}
+		}
+	}
+
+	bool fail(const char *msg) {
+		if (error.empty())
+			error = msg;
+		return false;
+	}
+
+	/**
+	 *  Read an opening tag, sets name and self-closing status
+	 */
+	bool readTag(std::string &name, bool &empty) {
+		skipMisc();
+		if (cur >= end || *cur != '<')
+			return fail("expected tag");
+		cur++;
+		auto start = cur;
+		while (cur < end && *cur != '>' && *cur != '/' && *cur != ' ')
+			cur++;
+		name.assign(start, cur);
+		while (cur < end && *cur != '>')
+			cur++;
+		if (cur >= end)
+			return fail("unterminated tag");
+		empty = cur[-1] == '/';
+		cur++;
+		return true;
+	}
+
+	bool readText(const char *tag, std::string &out) {
+		std::string close = std::string("</") + tag + ">";
+		auto start = cur;
+		if (!skipPast(close.c_str()))
+			return fail("unterminated element");
+		decodeEntities(start, cur - close.size(), out);
+		return true;
+	}
+
+	static void decodeEntities(const char *s, const char *e, std::string &out) {
+		out.clear();
+		out.reserve(e - s);
+		while (s < e) {
+			if (*s == '&') {
+				auto semi = static_cast<const char *>(memchr(s, ';', e - s));
+				if (semi) {
+					std::string ent(s + 1, semi);
+					if (ent == "lt") out += '<';
+					else if (ent == "gt") out += '>';
+					else if (ent == "amp") out += '&';
+					else if (ent == "quot") out += '"';
+					else if (ent == "apos") out += '\'';
+					else if (!ent.empty() && ent[0] == '#') {
+						unsigned long cp = ent.size() > 1 && (ent[1] == 'x' || ent[1] == 'X') ?
+							strtoul(ent.c_str() + 2, nullptr, 16) : strtoul(ent.c_str() + 1, nullptr, 10);
+						appendUtf8(out, cp);
+					} else {
+						out.append(s, semi + 1);
+					}
+					s = semi + 1;
+					continue;
+				}
+			}
+			out += *s++;
+		}
+	}
+
+	static void appendUtf8(std::string &out, unsigned long cp) {
+		if (cp < 0x80) {
+			out += static_cast<char>(cp);
+		} else if (cp < 0x800) {
+			out += static_cast<char>(0xC0 | (cp >> 6));
+			out += static_cast<char>(0x80 | (cp & 0x3F));
+		} else if (cp < 0x10000) {
+			out += static_cast<char>(0xE0 | (cp >> 12));
+			out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (cp & 0x3F));
+		} else {
+			out += static_cast<char>(0xF0 | (cp >> 18));
+			out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+			out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (cp & 0x3F));
+		}
+	}
+
+	static bool decodeBase64(const std::string &in, std::vector<uint8_t> &out) {
+		uint32_t acc {0};
+		int bits {0};
+		out.clear();
+		out.reserve(in.size() * 3 / 4);
+		for (auto c : in) {
+			int v;
+			if (c >= 'A' && c <= 'Z') v = c - 'A';
+			else if (c >= 'a' && c <= 'z') v = c - 'a' + 26;
+			else if (c >= '0' && c <= '9') v = c - '0' + 52;
+			else if (c == '+') v = 62;
+			else if (c == '/') v = 63;
+			else if (c == '=' || c == ' ' || c == '\t' || c == '\r' || c == '\n') continue;
+			else return false;
+			acc = (acc << 6) | static_cast<uint32_t>(v);
+			bits += 6;
+			if (bits >= 8) {
+				bits -= 8;
+				out.push_back(static_cast<uint8_t>(acc >> bits));
+			}
+		}
+		return true;
+	}
+
+	bool parseValue(Value &v) {
+		std::string name;
+		bool empty;
+		if (!readTag(name, empty))
+			return false;
+
+		if (name == "dict") {
+			v.type = Value::Type::Dict;
+			if (empty)
+				return true;
+			while (true) {
+				skipMisc();
+				if (startsWith("</dict>")) {
+					cur += strlen("</dict>");
+					return true;
+				}
+				std::string key;
+				if (!readTag(name, empty) || name != "key")
+					return fail("expected key");
+				if (!empty && !readText("key", key))
+					return false;
+				v.dict.emplace_back(std::move(key), Value {});
+				if (!parseValue(v.dict.back().second))
+					return false;
+			}
+		} else if (name == "array") {
+			v.type = Value::Type::Array;
+			if (empty)
+				return true;
+			while (true) {
+				skipMisc();
+				if (startsWith("</array>")) {
+					cur += strlen("</array>");
+					return true;
+				}
+				v.array.emplace_back();
+				if (!parseValue(v.array.back()))
+					return false;
+			}
+		} else if (name == "true" || name == "false") {
+			v.type = Value::Type::Boolean;
+			v.boolean = name == "true";
+			if (!empty)
+				return skipPast(name == "true" ? "</true>" : "</false>") || fail("unterminated boolean");
+			return true;
+		}
+
+		std::string text;
+		if (!empty && !readText(name.c_str(), text))
+			return false;
+
+		if (name == "string") {
+			v.type = Value::Type::String;
+			v.string = std::move(text);
+		} else if (name == "integer") {
+			v.type = Value::Type::Integer;
+			auto s = text.c_str();
+			while (*s == ' ' || *s == '\t' || *s == '\n') s++;
+			if (*s == '-')
+				v.integer = strtoll(s, nullptr, 0);
+			else
+				v.integer = static_cast<int64_t>(strtoull(s, nullptr, 0));
+		} else if (name == "real") {
+			v.type = Value::Type::Real;
+			v.real = strtod(text.c_str(), nullptr);
+		} else if (name == "data") {
+			v.type = Value::Type::Data;
+			if (!decodeBase64(text, v.data))
+				return fail("invalid base64 data");
+		} else if (name == "date") {
+			v.type = Value::Type::Date;
+			v.string = std::move(text);
+		} else {
+			return fail("unsupported element");
+		}
+
+		return true;
+	}
+
+public:
+	Parser(const char *data, size_t size) : cur(data), end(data + size) {}
+
+	bool parse(Value &root) {
+		if (!parseValue(root))
+			return false;
+		skipMisc();
+		return cur == end || fail("trailing garbage");
+	}
+
+	const std::string &lastError() const {
+		return error;
+	}
+};
+
+/**
+ *  Read the whole file into memory
+ *
+ *  @param path  file path
+ *  @param out   file contents
+ *
+ *  @return true on success
+ */
+static inline bool readFile(const std::string &path, std::vector<uint8_t> &out) {
+	auto f = fopen(path.c_str(), "rb");
+	if (!f)
+		return false;
+	out.clear();
+	uint8_t chunk[65536];
+	size_t n;
+	while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+		out.insert(out.end(), chunk, chunk + n);
+	bool ok = !ferror(f);
+	fclose(f);
+	return ok;
+}
+
+/**
+ *  Parse property list from memory
+ *
+ *  @param data  plist contents
+ *  @param size  plist size
+ *  @param root  parsed value
+ *
+ *  @return true on success
+ */
+static inline bool parse(const char *data, size_t size, Value &root) {
+	Parser p(data, size);
+	if (!p.parse(root)) {
+		fprintf(stderr, "ResourceConverter: plist error: %s\n", p.lastError().c_str());
+		root = Value {};
+		return false;
+	}
+	return true;
+}
+
+/**
+ *  Strip formatting from XML property list text for packing.
+ *  Whitespace between tags, inside data and comments are dropped,
+ *  while string and key contents are kept intact.
+ *
+ *  @param data  plist contents
+ *  @param size  plist size
+ *
+ *  @return canonical plist text
+ */
+static inline std::string canonicalize(const char *data, size_t size) {
+	std::string out;
+	out.reserve(size);
+	auto cur = data, end = data + size;
+	bool inData {false}, inText {false};
+
+	auto isSpace = [](char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; };
+
+	while (cur < end) {
+		if (*cur == '<') {
+			if (static_cast<size_t>(end - cur) >= 4 && memcmp(cur, "<!--", 4) == 0) {
+				static const char CommentEnd[] {"-->"};
+				auto close = std::search(cur + 4, end, CommentEnd, CommentEnd + 3);
+				cur = close != end ? close + 3 : end;
+				continue;
+			}
+
+			auto start = cur;
+			while (cur < end && *cur != '>')
+				cur++;
+			if (cur < end)
+				cur++;
+			std::string tag(start, cur);
+			inData = tag == "<data>";
+			inText = tag == "<string>" || tag == "<key>";
+			out += tag;
+			continue;
+		}
+
+		auto start = cur;
+		while (cur < end && *cur != '<')
+			cur++;
+		if (inData) {
+			for (auto p = start; p < cur; p++) {
+				if (!isSpace(*p))
+					out += *p;
+			}
+		} else if (inText || std::find_if_not(start, cur, isSpace) != cur) {
+			out.append(start, cur);
+		}
+	}
+
+	return out;
+}
+
+/**
+ *  Lay out an XML property list the way plutil -convert xml1 writes it, in a single pass.
+ *  Base64 data is joined into one line and integers are written in decimal,
+ *  other element contents are kept as they are. Comments are dropped.
+ *
+ *  @param data   plist contents
+ *  @param size   plist size
+ *  @param header emit the xml prolog and plist wrapper, layout and platform fragments go without
+ *  @param out    formatted plist
+ *
+ *  @return false for malformed or binary property lists
+ */
+static inline bool format(const char *data, size_t size, bool header, std::string &out) {
+	static const char Prolog[] {
+		"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+		"<plist version=\"1.0\">\n"
+	};
+
+	if (size >= 6 && memcmp(data, "bplist", 6) == 0)
+		return false;
+
+	auto cur = data, end = data + size;
+	auto isSpace = [](char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; };
+	auto startsWith = [&](const std::string &s) {
+		return static_cast<size_t>(end - cur) >= s.size() && memcmp(cur, s.data(), s.size()) == 0;
+	};
+	auto skipPast = [&](const std::string &s) {
+		auto found = std::search(cur, end, s.begin(), s.end());
+		cur = found != end ? found + s.size() : end;
+		return found != end;
+	};
+
+	// Whitespace, prolog, doctype, comments and the plist wrapper are regenerated
+	auto skipMisc = [&]() {
+		while (true) {
+			while (cur < end && isSpace(*cur))
+				cur++;
+			if (startsWith("<!--"))
+				skipPast("-->");
+			else if (startsWith("<?") || startsWith("<!") || startsWith("<plist") || startsWith("</plist"))
+				skipPast(">");
+			else
+				break;
+		}
+	};
+
+	out.clear();
+	out.reserve(size);
+	if (header)
+		out += Prolog;
+
+	size_t depth {0};
+	while (true) {
+		skipMisc();
+		if (cur >= end)
+			break;
+		if (*cur != '<')
+			return false;
+
+		auto start = ++cur;
+		while (cur < end && *cur != '>' && *cur != '/' && !isSpace(*cur))
+			cur++;
+		if (cur == start && cur < end && *cur == '/') {
+			cur++;
+			while (cur < end && *cur != '>' && !isSpace(*cur))
+				cur++;
+		}
+		std::string name(start, cur);
+		if (!skipPast(">"))
+			return false;
+		bool empty = cur[-2] == '/';
+
+		if (name[0] == '/') {
+			if (depth == 0 || (name != "/dict" && name != "/array"))
+				return false;
+			depth--;
+			out.append(depth, '\t');
+			out += "<" + name + ">\n";
+		} else if (name == "dict" || name == "array") {
+			// Empty containers collapse to <dict/>
+			skipMisc();
+			auto close = "</" + name + ">";
+			if (!empty && startsWith(close)) {
+				cur += close.size();
+				empty = true;
+			}
+			out.append(depth, '\t');
+			out += "<" + name + (empty ? "/>\n" : ">\n");
+			if (!empty)
+				depth++;
+		} else if (name == "true" || name == "false") {
+			if (!empty && !skipPast("</" + name + ">"))
+				return false;
+			out.append(depth, '\t');
+			out += "<" + name + "/>\n";
+		} else if (name == "key" || name == "string" || name == "integer" || name == "real" || name == "date" || name == "data") {
+			std::string text;
+			if (!empty) {
+				auto close = "</" + name + ">";
+				auto found = std::search(cur, end, close.begin(), close.end());
+				if (found == end)
+					return false;
+				text.assign(cur, found);
+				cur = found + close.size();
+			}
+
+			if (name == "data") {
+				text.erase(std::remove_if(text.begin(), text.end(), isSpace), text.end());
+			} else if (name == "integer") {
+				auto s = text.c_str();
+				while (isSpace(*s))
+					s++;
+				char *e {nullptr};
+				char num[32];
+				if (*s == '-')
+					snprintf(num, sizeof(num), "%lld", strtoll(s, &e, 0));
+				else
+					snprintf(num, sizeof(num), "%llu", strtoull(s, &e, 0));
+				while (e && isSpace(*e))
+					e++;
+				if (e && e != s && *e == '\0')
+					text = num;
+			}
+
+			out.append(depth, '\t');
+			out += "<" + name + ">" + text + "</" + name + ">\n";
+		} else {
+			return false;
+		}
+	}
+
+	if (depth != 0)
+		return false;
+	if (header)
+		out += "</plist>\n";
+	return true;
+}
+
+/**
+ *  Parse property list file, returns an empty value on failure
+ *
+ *  @param path  plist path
+ */
+static inline Value parseFile(const std::string &path) {
+	Value root;
+	std::vector<uint8_t> buf;
+	if (readFile(path, buf))
+		parse(reinterpret_cast<const char *>(buf.data()), buf.size(), root);
+	return root;
+}
+
+}
+
+#endif /* plist_hpp */
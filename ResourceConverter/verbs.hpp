@@ -0,0 +1,165 @@
+//
+//  verbs.hpp
+//  ResourceConverter
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+
+// Compiler for ConfigData and WakeConfigData verb streams of PinConfigs.kext.
+// Verbs are 32-bit big endian words: codec address, node id, verb and payload,
+// see alc-verb/hdaverb.h for the verb ids.
+
+#ifndef verbs_hpp
+#define verbs_hpp
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "writer.hpp"
+#include "../alc-verb/hdaverb.h"
+
+namespace Verbs {
+
+struct Verb {
+	uint32_t word;
+	uint8_t address;
+	uint8_t node;
+	uint16_t verb;
+};
+
+/**
+ *  Verbs with 4-bit ids take a 16-bit payload, all others an 8-bit one
+ */
+static inline uint16_t verbId(uint32_t word) {
+	uint16_t verb = (word >> 8) & 0xFFF;
+	switch (verb >> 8) {
+		case 0x2: case 0x3: case 0x4: case 0x5:
+			return verb & 0xF00;
+		default:
+			return verb;
+	}
+}
+
+/**
+ *  Setters whose register keeps only the last written value, writing one affects no other state.
+ *  Everything else, coefficients, amps, power states, GPIOs and resets, is kept in place and in order.
+ */
+static inline bool isRegister(uint16_t verb) {
+	switch (verb) {
+		case AC_VERB_SET_CONNECT_SEL:
+		case AC_VERB_SET_PIN_WIDGET_CONTROL:
+		case AC_VERB_SET_UNSOLICITED_ENABLE:
+		case AC_VERB_SET_EAPD_BTLENABLE:
+		case AC_VERB_SET_CONFIG_DEFAULT_BYTES_0:
+		case AC_VERB_SET_CONFIG_DEFAULT_BYTES_1:
+		case AC_VERB_SET_CONFIG_DEFAULT_BYTES_2:
+		case AC_VERB_SET_CONFIG_DEFAULT_BYTES_3:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/**
+ *  Only streams made of setters listed in hda_verbs are compiled, others are kept as is
+ */
+static inline bool isKnownSetter(uint16_t verb) {
+	for (auto v = hda_verbs; v->str; v++) {
+		if (v->val == verb)
+			return strncmp(v->str, "SET_", 4) == 0;
+	}
+	return false;
+}
+
+/**
+ *  Decode and validate a verb stream
+ *
+ *  @param data  verb bytes
+ *  @param verbs decoded verbs
+ *  @param error reason of the failure
+ *
+ *  @return true on success
+ */
+static inline bool decode(const std::vector<uint8_t> &data, std::vector<Verb> &verbs, std::string &error) {
+	if (data.size() % sizeof(uint32_t) != 0) {
+		error = "size is not a multiple of 4";
+		return false;
+	}
+
+	verbs.clear();
+	for (size_t i = 0; i < data.size(); i += sizeof(uint32_t)) {
+		uint32_t word = static_cast<uint32_t>(data[i]) << 24 | data[i+1] << 16 | data[i+2] << 8 | data[i+3];
+		Verb v {word, static_cast<uint8_t>(word >> 28), static_cast<uint8_t>(word >> 20), verbId(word)};
+		if (!isKnownSetter(v.verb)) {
+			error = format("unknown verb %08X at %zu", word, i);
+			return false;
+		}
+		if (!verbs.empty() && verbs[0].address != v.address) {
+			error = format("verb %08X at %zu addresses another codec", word, i);
+			return false;
+		}
+		if (v.node == 0 && isRegister(v.verb)) {
+			error = format("verb %08X at %zu targets the root node", word, i);
+			return false;
+		}
+		verbs.push_back(v);
+	}
+
+	return true;
+}
+
+/**
+ *  Compile a verb stream: register writes between two other verbs keep only the last
+ *  write of each node and verb, which also drops duplicates, and are grouped by node.
+ *
+ *  @param data  verb bytes
+ *  @param out   compiled verb bytes
+ *  @param error reason of the failure
+ *
+ *  @return true on success
+ */
+static inline bool compile(const std::vector<uint8_t> &data, std::vector<uint8_t> &out, std::string &error) {
+	std::vector<Verb> verbs;
+	if (!decode(data, verbs, error))
+		return false;
+
+	std::vector<Verb> program, segment;
+	auto flushSegment = [&]() {
+		std::vector<Verb> last;
+		for (auto it = segment.rbegin(); it != segment.rend(); ++it) {
+			if (std::none_of(last.begin(), last.end(), [&](const Verb &v) { return v.node == it->node && v.verb == it->verb; }))
+				last.push_back(*it);
+		}
+		std::reverse(last.begin(), last.end());
+		std::stable_sort(last.begin(), last.end(), [](const Verb &a, const Verb &b) { return a.node < b.node; });
+		program.insert(program.end(), last.begin(), last.end());
+		segment.clear();
+	};
+
+	for (auto &v : verbs) {
+		if (isRegister(v.verb)) {
+			segment.push_back(v);
+		} else {
+			flushSegment();
+			program.push_back(v);
+		}
+	}
+	flushSegment();
+
+	out.clear();
+	for (auto &v : program) {
+		out.push_back(v.word >> 24);
+		out.push_back(v.word >> 16);
+		out.push_back(v.word >> 8);
+		out.push_back(v.word);
+	}
+
+	return true;
+}
+
+}
+
+#endif /* verbs_hpp */
@@ -0,0 +1,214 @@
+//
+//  writer.hpp
+//  ResourceConverter
+//
+//  Copyright © 2016-2017 vit9696. All rights reserved.
+//
+
+#ifndef writer_hpp
+#define writer_hpp
+
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/**
+ *  Buffered output file kept open for the whole generation
+ */
+class OutputWriter {
+	FILE *file {nullptr};
+	std::string buffer;
+	bool failed {false};
+
+	/**
+	 *  Deferred output, see open
+	 */
+	std::string deferredPath;
+	bool deferred {false};
+	bool changed {false};
+
+	/**
+	 *  Flush threshold, generated sources are written in large chunks
+	 */
+	static constexpr size_t FlushSize {1024*1024};
+
+	void flushIfNeeded() {
+		if (!deferred && buffer.size() >= FlushSize)
+			flush();
+	}
+
+	/**
+	 *  Write the buffer unless the file already has identical contents
+	 */
+	void finishDeferred() {
+		std::string old;
+		if (auto f = fopen(deferredPath.c_str(), "rb")) {
+			char chunk[65536];
+			size_t n;
+			while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+				old.append(chunk, n);
+			fclose(f);
+		}
+
+		changed = old != buffer;
+		if (changed) {
+			file = fopen(deferredPath.c_str(), "wb");
+			if (!file || fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size())
+				failed = true;
+			if (file && fclose(file) != 0)
+				failed = true;
+			file = nullptr;
+		}
+
+		buffer.clear();
+		deferred = false;
+	}
+
+public:
+	OutputWriter() = default;
+	OutputWriter(const OutputWriter &) = delete;
+	OutputWriter &operator=(const OutputWriter &) = delete;
+
+	~OutputWriter() {
+		close();
+	}
+
+	/**
+	 *  Create or truncate the output file
+	 *
+	 *  @param path  output path
+	 *
+	 *  @return true on success
+	 */
+	bool open(const std::string &path) {
+		close();
+		file = fopen(path.c_str(), "wb");
+		failed = file == nullptr;
+		changed = true;
+		buffer.reserve(FlushSize * 2);
+		return file != nullptr;
+	}
+
+	/**
+	 *  Collect the whole output in memory and only replace the file when its contents differ,
+	 *  so that build systems do not recompile unchanged generated sources
+	 *
+	 *  @param path  output path
+	 */
+	void openDeferred(const std::string &path) {
+		close();
+		deferredPath = path;
+		deferred = true;
+		failed = false;
+		changed = false;
+	}
+
+	/**
+	 *  Whether the last closed file was written
+	 */
+	bool wasChanged() const {
+		return changed;
+	}
+
+	void append(const std::string &str) {
+		buffer += str;
+		flushIfNeeded();
+	}
+
+	void append(const char *str) {
+		buffer += str;
+		flushIfNeeded();
+	}
+
+	__attribute__((format(printf, 2, 3)))
+	void appendf(const char *format, ...) {
+		char tmp[1024];
+		va_list va, vc;
+		va_start(va, format);
+		va_copy(vc, va);
+		int len = vsnprintf(tmp, sizeof(tmp), format, va);
+		if (len >= 0 && static_cast<size_t>(len) < sizeof(tmp)) {
+			buffer.append(tmp, len);
+		} else if (len > 0) {
+			auto off = buffer.size();
+			buffer.resize(off + len + 1);
+			vsnprintf(&buffer[off], len + 1, format, vc);
+			buffer.resize(off + len);
+		}
+		va_end(vc);
+		va_end(va);
+		flushIfNeeded();
+	}
+
+	/**
+	 *  Append bytes as a C array initialiser body, 24 bytes per line
+	 *
+	 *  @param data  bytes
+	 *  @param size  byte count
+	 */
+	void appendBytes(const uint8_t *data, size_t size) {
+		static const char hex[] = "0123456789ABCDEF";
+		for (size_t i = 0; i < size; ) {
+			buffer += '\t';
+			for (size_t p = 0; p < 24 && i < size; p++, i++) {
+				char b[6] {'0', 'x', hex[data[i] >> 4], hex[data[i] & 0xF], ',', ' '};
+				buffer.append(b, sizeof(b));
+			}
+			buffer += '\n';
+		}
+		flushIfNeeded();
+	}
+
+	void flush() {
+		if (deferred)
+			return;
+		if (file && !buffer.empty()) {
+			if (fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size())
+				failed = true;
+		}
+		buffer.clear();
+	}
+
+	/**
+	 *  Flush pending data and close the file
+	 *
+	 *  @return true if everything was written
+	 */
+	bool close() {
+		if (deferred)
+			finishDeferred();
+		if (file) {
+			flush();
+			if (fclose(file) != 0)
+				failed = true;
+			file = nullptr;
+		}
+		return !failed;
+	}
+};
+
+/**
+ *  printf-like std::string formatter
+ */
+__attribute__((format(printf, 1, 2)))
+static inline std::string format(const char *fmt, ...) {
+	char tmp[512];
+	va_list va, vc;
+	va_start(va, fmt);
+	va_copy(vc, va);
+	int len = vsnprintf(tmp, sizeof(tmp), fmt, va);
+	std::string out;
+	if (len >= 0 && static_cast<size_t>(len) < sizeof(tmp)) {
+		out.assign(tmp, len);
+	} else if (len > 0) {
+		out.resize(len + 1);
+		vsnprintf(&out[0], len + 1, fmt, vc);
+		out.resize(len);
+	}
+	va_end(vc);
+	va_end(va);
+	return out;
+}
+
+#endif /* writer_hpp */
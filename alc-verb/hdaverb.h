@@ -165,7 +165,8 @@ static struct strtbl hda_verbs[] =
 	{ }, /* end */
 };
 
-static struct strtbl hda_params[] =
+/* Only alc-verb uses parameter names, ResourceConverter includes this header for hda_verbs */
+static struct strtbl hda_params[] __attribute__((unused)) =
 {
 	PARMSTR(VENDOR_ID),
 	PARMSTR(SUBSYSTEM_ID),